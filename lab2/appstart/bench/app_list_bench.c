@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include "app_list.h"
+#include "histogram.h"
+#include "zygote.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#define DEFAULT_ENTRIES (100000)
+#define DEFAULT_INSTANCES (2000)
+#define DEFAULT_EXECUTABLE "/bin/true"
+#define ITEMS_PER_PAGE (10)
+
+/* Full catalog scans, each builds and frees a catalog. */
+#define SEARCH_RUNS (5)
+
+/* O(1) calls are timed in batches, a clock read costs more than one call. */
+#define BATCH_SIZE (1000)
+#define BATCHES (1000)
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+/* Results are summed up here, so the calls cannot be optimized away. */
+static volatile uintptr_t sink;
+
+static int displayed_items = 0;
+
+static uint64_t next_random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void report(const char *name, const struct hg *hg)
+{
+    char summary[128];
+    hg_format(hg, summary, sizeof(summary));
+    printf("%-22s %s\n", name, summary);
+}
+
+static void count_item(struct al_item *item, int index)
+{
+    sink += (uintptr_t)item;
+    displayed_items++;
+}
+
+/* Fill dir with entries empty files, like a very large bin directory. */
+static int create_entries(const char *dir, int entries)
+{
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0)
+        return EXIT_FAILURE;
+    char name[32];
+    for (int i = 0; i < entries; i++)
+    {
+        snprintf(name, sizeof(name), "app-%08x-%d", (unsigned int)next_random(), i);
+        int fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0755);
+        if (fd < 0)
+        {
+            close(dirfd);
+            return EXIT_FAILURE;
+        }
+        close(fd);
+    }
+    close(dirfd);
+    return EXIT_SUCCESS;
+}
+
+/* Remove dir and whatever create_entries got to create in it. */
+static void remove_entries(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (d != NULL)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL)
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+                unlinkat(dirfd(d), entry->d_name, 0);
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+static void dispose_all(struct al_item *apps)
+{
+    while (apps != NULL)
+    {
+        struct al_item *next = apps->next;
+        al_dispose(apps);
+        apps = next;
+    }
+}
+
+static struct al_item *bench_search(const char *dir, int entries)
+{
+    struct hg hg;
+    hg_init(&hg);
+    struct al_item *apps = NULL;
+    for (int run = 0; run < SEARCH_RUNS; run++)
+    {
+        dispose_all(apps);
+        uint64_t start = now_ns();
+        int count = al_search(dir, &apps);
+        hg_add(&hg, now_ns() - start);
+        if (count != entries)
+        {
+            fprintf(stderr, "al_search found %d of %d entries!\n", count, entries);
+            dispose_all(apps);
+            return NULL;
+        }
+    }
+    report("al_search", &hg);
+    return apps;
+}
+
+static void bench_catalog(struct al_item *apps, int entries)
+{
+    struct hg at;
+    struct hg at_back;
+    struct hg skip;
+    struct hg display;
+    hg_init(&at);
+    hg_init(&at_back);
+    hg_init(&skip);
+    hg_init(&display);
+
+    struct al_item *last = al_at(apps, entries - 1);
+    int pages = (entries + ITEMS_PER_PAGE - 1) / ITEMS_PER_PAGE;
+    for (int batch = 0; batch < BATCHES; batch++)
+    {
+        uint64_t start = now_ns();
+        for (int i = 0; i < BATCH_SIZE; i++)
+            sink += (uintptr_t)al_at(apps, next_random() % entries);
+        hg_add(&at, (now_ns() - start) / BATCH_SIZE);
+
+        start = now_ns();
+        for (int i = 0; i < BATCH_SIZE; i++)
+            sink += (uintptr_t)al_at(last, -(int)(next_random() % entries));
+        hg_add(&at_back, (now_ns() - start) / BATCH_SIZE);
+
+        start = now_ns();
+        for (int i = 0; i < BATCH_SIZE; i++)
+            sink += (uintptr_t)al_skip_pages(apps, next_random() % pages, ITEMS_PER_PAGE);
+        hg_add(&skip, (now_ns() - start) / BATCH_SIZE);
+    }
+
+    /* Page through the whole catalog, one sample per page. */
+    struct al_item *page = apps;
+    displayed_items = 0;
+    while (page != NULL)
+    {
+        int displayed = 0;
+        uint64_t start = now_ns();
+        page = al_display_page(page, ITEMS_PER_PAGE, &displayed, count_item);
+        hg_add(&display, now_ns() - start);
+    }
+    if (displayed_items != entries)
+        fprintf(stderr, "al_display_page showed %d of %d entries!\n", displayed_items, entries);
+
+    report("al_at", &at);
+    report("al_at backwards", &at_back);
+    report("al_skip_pages", &skip);
+    report("al_display_page", &display);
+}
+
+static void bench_lifecycle(const char *executable, int instances)
+{
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", executable);
+    char *slash = strrchr(dir, '/');
+    if (slash == NULL)
+    {
+        fprintf(stderr, "%s is not a path!\n", executable);
+        return;
+    }
+    *slash = '\0';
+
+    struct al_item *app;
+    if (al_create(&app, dir, slash + 1, NULL, NULL) != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Could not create an item for %s!\n", executable);
+        return;
+    }
+
+    struct hg create;
+    struct hg closing;
+    hg_init(&create);
+    hg_init(&closing);
+    int failed = 0;
+    uint64_t started = now_ns();
+    for (int i = 0; i < instances; i++)
+    {
+        uint64_t start = now_ns();
+        struct al_instance *instance = al_create_instance(app);
+        uint64_t created = now_ns();
+        if (instance == NULL)
+        {
+            failed++;
+            continue;
+        }
+        hg_add(&create, created - start);
+        al_close_instance(instance);
+        hg_add(&closing, now_ns() - created);
+    }
+    double seconds = (now_ns() - started) / 1e9;
+    report("al_create_instance", &create);
+    report("al_close_instance", &closing);
+    printf("%-22s %d launched and closed in %.2fs, %.0f/s, %d failed\n", "one by one", instances - failed, seconds,
+           (instances - failed) / seconds, failed);
+
+    /* All at once, closing them in one batch. */
+    uint64_t start = now_ns();
+    int created = al_create_instances(app, instances);
+    uint64_t launched = now_ns();
+    al_close_instances(app);
+    uint64_t closed = now_ns();
+    printf("%-22s %d launched in %.2fs, closed in %.2fs\n", "all at once", created, (launched - start) / 1e9,
+           (closed - launched) / 1e9);
+
+    al_dispose(app);
+}
+
+int main(int argc, char *argv[])
+{
+    int entries = DEFAULT_ENTRIES;
+    int instances = DEFAULT_INSTANCES;
+    const char *executable = DEFAULT_EXECUTABLE;
+    const char *parent = getenv("TMPDIR");
+    int zygote = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:i:x:d:z")) != -1)
+    {
+        switch (opt)
+        {
+        case 'z':
+            zygote = 1;
+            break;
+        case 'n':
+            entries = strtol(optarg, NULL, 10);
+            break;
+        case 'i':
+            instances = strtol(optarg, NULL, 10);
+            break;
+        case 'x':
+            executable = optarg;
+            break;
+        case 'd':
+            parent = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n entries] [-i instances] [-x executable] [-d parent dir] [-z]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (parent == NULL || *parent == '\0')
+        parent = "/tmp";
+
+    /* Launch through the helper, forked while the heap is still small. */
+    if (zygote && zy_start() != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Could not start the launcher helper!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (entries > 0)
+    {
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s/app_list_bench.XXXXXX", parent);
+        if (mkdtemp(dir) == NULL)
+        {
+            fprintf(stderr, "Could not create a directory in %s: %s\n", parent, strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        uint64_t start = now_ns();
+        if (create_entries(dir, entries) != EXIT_SUCCESS)
+        {
+            fprintf(stderr, "Could not create %d entries in %s: %s\n", entries, dir, strerror(errno));
+            remove_entries(dir);
+            return EXIT_FAILURE;
+        }
+        printf("%-22s %d entries in %.2fs\n", "setup", entries, (now_ns() - start) / 1e9);
+
+        struct al_item *apps = bench_search(dir, entries);
+        remove_entries(dir);
+        if (apps == NULL)
+            return EXIT_FAILURE;
+        bench_catalog(apps, entries);
+        dispose_all(apps);
+    }
+
+    if (instances > 0)
+        bench_lifecycle(executable, instances);
+    zy_stop();
+    return EXIT_SUCCESS;
+}
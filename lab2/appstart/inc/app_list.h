@@ -1,19 +1,120 @@
 #ifndef APP_LIST_H_
 #define APP_LIST_H_
 
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <sys/resource.h>
+
+#include "histogram.h"
+#include "output_log.h"
+#include "resource_sampler.h"
+#include "ring_buffer.h"
+
+/* Number of most recent output bytes kept per instance. */
+#define AL_OUTPUT_BUFFER_SIZE (8 * 1024)
+
+/* Default time closed instances get to exit before they are killed. */
+#define AL_CLOSE_GRACE_MS (2000)
+
+struct el_handler;
+struct al_catalog;
+
 struct al_instance
 {
     pid_t pid;
     int stdout;
     int stderr;
 
+    /* Combined stdout/stderr, drained by the event loop if one is active.
+     * The log gets all of it, if logging is enabled, see al_set_log_dir. */
+    struct rb output;
+    struct ol_log log;
+    struct el_handler *stdout_handler;
+    struct el_handler *stderr_handler;
+
+    /* Launch timings, first_output_ns is -1 until the first byte arrived. */
+    struct timespec launched;
+    int64_t fork_ns;
+    int64_t exec_ns;
+    int64_t first_output_ns;
+
+    /* Exit tracking, see al_watch_exits. pidfd is -1 without pidfd support. */
+    int pidfd;
+    struct el_handler *exit_handler;
+    struct timespec started;
+    struct timespec ended;
+    int watched;
+    int exited;
+    int status;
+    int closing;
+
+    /* Sampled while the instance runs, the last sample stays after exit. */
+    struct rs_usage usage;
+
+    /* Own cgroup v2, removed when the instance is freed, killing whatever is
+     * still in it. NULL if none. */
+    char *cgroup;
+
+    /* Descendants reparented to appstart and reaped, with their CPU time in
+     * seconds. The instance leads a process group of its own, by which they
+     * are matched, see al_watch_exits. */
+    int orphans;
+    double orphan_cpu;
+
     struct al_item *app;
     struct al_instance *next;
     struct al_instance *previous;
 };
 
+/**
+ * @brief Histograms of all launches: time until the child ran (fork), until
+ * execl succeeded (exec) and until the first output byte was read.
+ */
+struct al_launch_timings
+{
+    struct hg fork;
+    struct hg exec;
+    struct hg first_output;
+};
+
+/**
+ * @brief Settings applied to a forked child before execl. Fields left as set
+ * by al_init_launch_options are inherited from appstart.
+ */
+struct al_launch_options
+{
+    /* CPUs to run on, used if cpu_count > 0. */
+    cpu_set_t cpus;
+    int cpu_count;
+
+    /* Nice value, used if set_nice is non-zero. */
+    int set_nice;
+    int nice;
+
+    /* Scheduling policy like SCHED_BATCH or SCHED_FIFO, -1 to inherit. */
+    int policy;
+    int priority;
+
+    /* Limits for RLIMIT_AS and RLIMIT_NOFILE, RLIM_INFINITY to inherit. Both
+     * soft and hard limit are set, so the instance cannot raise them again. */
+    rlim_t address_space;
+    rlim_t open_files;
+
+    /* The instance gets a cgroup of its own if any of these is set, see
+     * cg_create. cpu_max is "quota period" or "max period". */
+    char cpu_max[32];
+    uint64_t memory_max;
+};
+
+/**
+ * @brief Callback invoked after an instance exited and was reaped. The instance
+ * stays in its app's list until it is closed.
+ */
+typedef void (*al_exit_callback)(struct al_instance *instance, void *data);
+
 struct al_item
 {
     char *path;
@@ -21,10 +122,134 @@ struct al_item
 
     struct al_instance *instances;
 
+    /* Owning catalog and position in it, NULL for items made by al_create. */
+    struct al_catalog *catalog;
+    int index;
+
     struct al_item *next;
     struct al_item *previous;
 };
 
+/**
+ * @brief Contiguous application catalog. All path strings live in one string
+ * pool, all items in one flat array sorted by name, so any index or page is
+ * reachable in O(1). The next and previous pointers of the items are linked
+ * as well, so the list based al_* functions work on a catalog unchanged.
+ */
+struct al_catalog
+{
+    struct al_item *items;
+    int count;
+
+    char *pool;
+    size_t pool_length;
+    size_t pool_capacity;
+
+    /* Pool offsets collected by al_catalog_add until al_catalog_finish. */
+    size_t *pending;
+    int pending_capacity;
+
+    /* Number of items not yet disposed by al_dispose. */
+    int live;
+
+    /* Set if the pool lives in a read-only mapping, see al_catalog_map. */
+    void *mapping;
+    size_t mapping_length;
+};
+
+/**
+ * @brief Position independent description of a finished catalog item, given
+ * as byte offsets of its path and name into the string pool.
+ */
+struct al_catalog_entry
+{
+    uint32_t path;
+    uint32_t name;
+};
+
+/**
+ * @brief Initialize an empty catalog.
+ */
+void al_catalog_init(struct al_catalog *catalog);
+
+/**
+ * @brief Add an app to a catalog that has not been finished yet.
+ *
+ * @param[in] catalog
+ * Catalog to add to.
+ *
+ * @param[in] dir
+ * C-string of the base-dir where the app is located in. May be NULL for apps
+ * that shall be looked up via PATH variable.
+ *
+ * @param[in] name
+ * C-string of the app name. Must not be NULL.
+ *
+ * @return EXIT_SUCCESS on success, an error-code otherwise.
+ */
+int al_catalog_add(struct al_catalog *catalog, const char *dir, const char *name);
+
+/**
+ * @brief Sort the added apps by name and lay them out as one flat item array
+ * with a compacted string pool. If a name was added more than once, only the
+ * first one added is kept.
+ *
+ * @return EXIT_SUCCESS on success, an error-code otherwise.
+ */
+int al_catalog_finish(struct al_catalog *catalog);
+
+/**
+ * @brief Add a copy of an item of another, finished catalog.
+ *
+ * @return EXIT_SUCCESS on success, an error-code otherwise.
+ */
+int al_catalog_add_item(struct al_catalog *catalog, const struct al_item *item);
+
+/**
+ * @brief Finish a catalog on top of an already sorted and deduplicated string
+ * pool without copying it, e.g. one inside a mapped cache file.
+ *
+ * @param[in] pool
+ * String pool the entries point into. Must stay valid for the lifetime of the
+ * catalog.
+ *
+ * @param[in] entries
+ * Item offsets into the pool, sorted by name.
+ *
+ * @param[in] mapping
+ * Mapping the pool lives in. It is handed over to the catalog and unmapped by
+ * al_catalog_dispose.
+ *
+ * @return EXIT_SUCCESS on success, an error-code otherwise.
+ */
+int al_catalog_map(struct al_catalog *catalog, const char *pool, size_t pool_length,
+                   const struct al_catalog_entry *entries, int count,
+                   void *mapping, size_t mapping_length);
+
+/**
+ * @brief Close all instances of all items and free the catalog's arena.
+ */
+void al_catalog_dispose(struct al_catalog *catalog);
+
+/**
+ * @brief Return the item at the given index in O(1) or NULL if out of range.
+ */
+struct al_item *al_catalog_at(const struct al_catalog *catalog, int index);
+
+/**
+ * @brief Binary search a finished catalog for an app name.
+ *
+ * @return Index of the item or -1 if there is none.
+ */
+int al_catalog_find(const struct al_catalog *catalog, const char *name);
+
+/**
+ * @brief Move the running instances of every item to the item with the same
+ * name in another finished catalog. Items without a counterpart keep their
+ * instances.
+ */
+void al_catalog_migrate(struct al_catalog *from, struct al_catalog *to);
+
 /**
  * @brief Create an al_item with the given next and previous pointer.
  *
@@ -51,7 +276,8 @@ int al_create(struct al_item **apps, const char *dir, const char *name, struct a
 
 /**
  * @brief Dispose of app in app list by closing all associated instances and
- * freeing allocated resources.
+ * freeing allocated resources. Items of a catalog are freed together with
+ * their catalog once the last of them was disposed.
  *
  * @param[in] app
  * Item to dispose.
@@ -61,28 +287,147 @@ void al_dispose(struct al_item *app);
 /**
  * @brief Create a new app instance using the given al_item app context.
  * The new instance will be appended to the al_item instances list.
+ * If the event loop is active, the instance's stdout and stderr pipes are
+ * registered non-blocking and drained into its output ring buffer, so the
+ * instance never stalls on a full pipe. If the launcher helper is running, see
+ * zy_start, it spawns the process instead of a fork of the caller.
  *
  * @param[in] app
  * Context of which to create a new instance from.
  *
- * @return Pointer to the newly created instance or NULL on error.
+ * @return Pointer to the newly created instance or NULL on error, including a
+ * failed execl, with errno set.
  */
 struct al_instance *al_create_instance(struct al_item *app);
 
+/**
+ * @brief Reset launch options to inherit everything.
+ */
+void al_init_launch_options(struct al_launch_options *options);
+
+/**
+ * @brief Set one launch option from its text form:
+ *
+ * cpus=0-3,6 nice=N sched=other|batch|idle|fifo:P|rr:P as=SIZE nofile=N
+ * cpu.max=PERCENT%|QUOTA/PERIOD|max mem.max=SIZE
+ *
+ * where SIZE is a number of bytes with an optional K, M or G suffix, and P
+ * a priority in the range of the policy, see sched_get_priority_max(2).
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE for an unknown key or an
+ * invalid value.
+ */
+int al_parse_launch_option(struct al_launch_options *options, const char *option);
+
+/**
+ * @brief Like al_create_instance, but apply options to the child. Always
+ * forks, since the launcher helper cannot apply them.
+ *
+ * @param[in] options
+ * Options to apply, NULL behaves like al_create_instance.
+ *
+ * @return Pointer to the newly created instance or NULL on error, including a
+ * failed option or execl, with errno set.
+ */
+struct al_instance *al_create_instance_with_options(struct al_item *app, const struct al_launch_options *options);
+
+/**
+ * @brief Look up an instance by pid in O(1). Includes exited instances that
+ * were not closed yet, as long as their pid was not reused, and closed ones
+ * that were not reaped yet, which have no app.
+ *
+ * @return The instance or NULL.
+ */
+struct al_instance *al_find_instance(pid_t pid);
+
+/**
+ * @brief Launch timings of all instances created so far.
+ */
+const struct al_launch_timings *al_get_launch_timings(void);
+
+/**
+ * @brief Create several instances of an app. With the launcher helper running,
+ * see zy_start, the requests are pipelined.
+ *
+ * @return Number of instances created.
+ */
+int al_create_instances(struct al_item *app, int count);
+
 /**
  * @brief Close a instance, free all associated resources and remove it from the
  * instances list.
+ *
+ * Running instances and their process group are sent SIGTERM. If exits are
+ * watched, the instance is only detached and freed once it was reaped,
+ * otherwise this waits for it like al_wait_closing. Descendants still in its
+ * process group are sent SIGKILL right before it is reaped. An instance that
+ * had already exited has no process group to signal any more, its group id
+ * may have been reused; only the descendants in its cgroup, if it has one,
+ * are killed then.
  */
 void al_close_instance(struct al_instance *instance);
 
 /**
- * @brief Close all instances associated with the given app context.
+ * @brief Wait for all closed instances at once and reap them. Instances still
+ * running after the grace period are sent SIGKILL, so the wait is bounded by
+ * the grace period plus the time the slowest one takes to die.
+ */
+void al_wait_closing(void);
+
+/**
+ * @brief Set the time closed instances get to exit before they are sent
+ * SIGKILL. Defaults to AL_CLOSE_GRACE_MS.
+ */
+void al_set_close_grace(int milliseconds);
+
+/**
+ * @brief Spool the output of instances launched from now on into
+ * dir/<name>.<pid>.log, see ol_open.
+ *
+ * @param[in] dir
+ * Existing directory, NULL disables logging. Must stay alive.
+ *
+ * @param[in] rotate_size
+ * Size in bytes at which logs are rotated.
+ */
+void al_set_log_dir(const char *dir, off_t rotate_size);
+
+/**
+ * @brief Reap exiting instances from the event loop. Uses a pidfd per instance
+ * or, on kernels without pidfd_open, a signalfd for SIGCHLD. Must be called
+ * after el_init and before the first instance is created.
+ *
+ * Also makes appstart a child subreaper, so descendants of instances are
+ * reparented to it. They are reaped through SIGCHLD and counted in the
+ * orphans of the instance whose process group they are in.
+ *
+ * @param[in] callback
+ * Function to call for every reaped instance. May be NULL.
+ *
+ * @return EXIT_SUCCESS on success, an error-code otherwise.
+ */
+int al_watch_exits(al_exit_callback callback, void *data);
+
+/**
+ * @brief Wait for every closed instance, see al_wait_closing, and stop watching
+ * exits. All instances have to be closed before.
+ */
+void al_unwatch_exits(void);
+
+/**
+ * @brief Time in seconds an instance ran, or runs so far.
+ */
+double al_instance_runtime(const struct al_instance *instance);
+
+/**
+ * @brief Close all instances associated with the given app context. All of
+ * them are signaled before any is waited for.
  */
 void al_close_instances(struct al_item *app);
 
 /**
  * @brief Create an al_item list by scanning through the contents of a
- * directory.
+ * directory. The items are allocated as one catalog sorted by name.
  *
  * @param[in] dir_path
  * Path to a directory to search through.
@@ -115,7 +460,8 @@ int al_search(const char *dir_path, struct al_item **apps);
  * Number of items that fit on one page.
  *
  * @return Pointer to the element advanced by the requested number of pages or
- * the last element in the list.
+ * NULL if that is beyond either end of the list. If itemsPerPage is negative
+ * the last (or first) element in the list. O(1) for catalog items.
  */
 struct al_item *al_skip_pages(struct al_item *apps, int page, int itemsPerPage);
 
@@ -150,7 +496,7 @@ struct al_item *al_display_page(struct al_item *apps, int itemsPerPage, int *dis
  * Index of item to return. If positive the next attribute will be used. If
  * negative the previous attribute will be used.
  *
- * @return Item at index or NULL.
+ * @return Item at index or NULL. O(1) for catalog items.
  */
 struct al_item *al_at(struct al_item *apps, int index);
 
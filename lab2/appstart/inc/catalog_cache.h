@@ -0,0 +1,99 @@
+#ifndef CATALOG_CACHE_H_
+#define CATALOG_CACHE_H_
+
+#include "app_list.h"
+
+/* Bump whenever the layout of the cache file changes. */
+#define CC_VERSION (1)
+#define CC_MAGIC "APPSTCAT"
+
+/* Size of the buffer inotify events are read into. */
+#define CC_EVENT_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Callback invoked after the catalog was replaced by an updated one.
+ * Instances are already moved over, the old catalog is freed once the callback
+ * returns, so every pointer into it has to be replaced.
+ */
+typedef void (*cc_callback)(struct al_catalog *old, struct al_catalog *catalog, void *data);
+
+/**
+ * @brief State of one directory when its entries were read. A missing
+ * directory has all fields zeroed.
+ */
+struct cc_stamp
+{
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+/**
+ * @brief Catalog of a list of directories, backed by a cache file.
+ *
+ * The cache file is laid out as a header, one stamp per directory, the item
+ * entries and the string pool, all addressed by offsets, so it can be mapped
+ * and used in place. It is valid as long as the directory list and every
+ * directory's mtime match the stamps.
+ */
+struct cc_cache
+{
+    char *file;
+    char *dirs;
+    char **dir_list;
+    struct cc_stamp *stamps;
+    int dir_count;
+    int threads;
+
+    struct al_catalog *catalog;
+
+    int inotify_fd;
+    struct el_handler *handler;
+    cc_callback callback;
+    void *data;
+};
+
+/**
+ * @brief Load the catalog of a list of directories from a cache file, or scan
+ * the directories and write the cache file if it is missing or stale.
+ *
+ * @param[in] file
+ * Path of the cache file. May be NULL to always scan.
+ *
+ * @param[in] dirs
+ * Colon separated list of directories, see ps_scan.
+ *
+ * @param[in] threads
+ * Number of threads to scan with, see ps_scan.
+ *
+ * @retval >= 0
+ * Number of apps in cache->catalog.
+ *
+ * @retval < 0
+ * On error.
+ */
+int cc_open(struct cc_cache *cache, const char *file, const char *dirs, int threads);
+
+/**
+ * @brief Watch the directories with inotify from the event loop. Changed names
+ * are resolved against the directories again and the catalog is rebuilt from
+ * the current one, without rescanning. The cache file is rewritten afterwards.
+ *
+ * @return EXIT_SUCCESS on success, an error-code otherwise.
+ */
+int cc_watch(struct cc_cache *cache, cc_callback callback, void *data);
+
+/**
+ * @brief Write the catalog to the cache file, replacing it atomically.
+ *
+ * @return EXIT_SUCCESS on success, an error-code otherwise.
+ */
+int cc_store(const struct cc_cache *cache);
+
+/**
+ * @brief Stop watching and dispose the catalog including all instances.
+ */
+void cc_close(struct cc_cache *cache);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef CGROUP_H_
+#define CGROUP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Leaf cgroup appstart moves itself into, since a cgroup with processes of
+ * its own cannot hand controllers down to child cgroups. */
+#define CG_SELF_NAME "appstart"
+
+/**
+ * @brief Create a cgroup v2 for one instance below the cgroup appstart was
+ * started in, which therefore has to be delegated to it, e.g. by
+ * systemd-run --user --scope -p Delegate=yes. The cpu and memory controllers
+ * are enabled as needed.
+ *
+ * @param[in] cpu_max
+ * Content for cpu.max like "50000 100000", NULL or empty to leave it.
+ *
+ * @param[in] memory_max
+ * Bytes for memory.max, 0 to leave it.
+ *
+ * @param[out] path
+ * Path of the new cgroup.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise with errno set.
+ */
+int cg_create(const char *cpu_max, uint64_t memory_max, char *path, size_t length);
+
+/**
+ * @brief Open the cgroup.procs file of a cgroup, so a forked child can move
+ * itself by writing "0" to it before execl.
+ *
+ * @return File descriptor or -1.
+ */
+int cg_open_procs(const char *path);
+
+/**
+ * @brief Kill every process in a cgroup through cgroup.kill, Linux 5.14 or
+ * later. Unlike a process group, this also reaches processes that moved to a
+ * group or session of their own.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise with errno set.
+ */
+int cg_kill(const char *path);
+
+/**
+ * @brief Remove a cgroup. Processes still in it are killed, and the removal
+ * waits for cgroup.events to report it unpopulated.
+ *
+ * @param[in] timeout
+ * Milliseconds to wait for the killed processes to exit.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise with errno set.
+ */
+int cg_remove(const char *path, int timeout);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef CONTROL_SOCKET_H_
+#define CONTROL_SOCKET_H_
+
+#include "app_list.h"
+#include "catalog_cache.h"
+
+/* Longest request line, longer ones are answered with an error. */
+#define CS_LINE_MAX (4096)
+
+/* Pending connections the listening socket queues. */
+#define CS_BACKLOG (64)
+
+/**
+ * @brief Serve the catalog of a cache on a Unix stream socket from the event
+ * loop. Requests are lines, every response is either "ok N" followed by N
+ * lines of data or a single "err message" line:
+ *
+ * list [offset [count]]     lines "index name path pid,pid|-"
+ * search query [count]      lines "index name", best matches first
+ * launch name [count] [opt=value ...]
+ *                           lines "pid", see al_parse_launch_option
+ * close pid|name            no lines, closes one or all instances
+ * stats                     lines "key value..."
+ *
+ * All complete lines a client sent are handled in one event loop iteration
+ * and answered with one write.
+ *
+ * @param[in] path
+ * Socket path. An existing file there is replaced.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+ */
+int cs_open(const char *path, struct cc_cache *cache);
+
+/**
+ * @brief Follow a replaced catalog, see cc_callback.
+ */
+void cs_set_catalog(struct al_catalog *catalog);
+
+/**
+ * @brief Disconnect all clients, close and unlink the socket.
+ */
+void cs_close(void);
+
+#endif
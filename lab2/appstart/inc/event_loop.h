@@ -0,0 +1,99 @@
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include <stdint.h>
+
+struct el_handler;
+
+/**
+ * @brief Callback invoked for every ready file descriptor.
+ *
+ * @param[in] handler
+ * Registration the event belongs to. May be removed from within the callback.
+ *
+ * @param[in] fd
+ * The ready file descriptor.
+ *
+ * @param[in] events
+ * Bitmask of ready epoll events (EPOLLIN, EPOLLHUP, ...).
+ *
+ * @param[in] data
+ * User data passed on registration.
+ */
+typedef void (*el_callback)(struct el_handler *handler, int fd, uint32_t events, void *data);
+
+struct el_handler
+{
+    int fd;
+    el_callback callback;
+    void *data;
+
+    struct el_handler *next_removed;
+};
+
+/**
+ * @brief Create the process-wide epoll instance.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+ */
+int el_init(void);
+
+/**
+ * @brief Close the epoll instance and free all pending registrations.
+ */
+void el_dispose(void);
+
+/**
+ * @brief Check whether el_init was called successfully.
+ */
+int el_active(void);
+
+/**
+ * @brief Register a file descriptor with the event loop.
+ *
+ * @param[in] fd
+ * File descriptor to watch. Ownership stays with the caller.
+ *
+ * @param[in] events
+ * epoll events to watch for, e.g. EPOLLIN.
+ *
+ * @param[in] callback
+ * Function to call when the file descriptor is ready.
+ *
+ * @param[in] data
+ * User data handed to the callback.
+ *
+ * @return Handle of the registration or NULL on error or if the event loop is
+ * not active.
+ */
+struct el_handler *el_add(int fd, uint32_t events, el_callback callback, void *data);
+
+/**
+ * @brief Change the epoll events a registration watches for.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+ */
+int el_modify(struct el_handler *handler, uint32_t events);
+
+/**
+ * @brief Unregister a file descriptor. Must be called before the file
+ * descriptor is closed. The handle is freed once the current dispatch round is
+ * over, so it is safe to call from within any callback.
+ */
+void el_remove(struct el_handler *handler);
+
+/**
+ * @brief Wait for events and dispatch them to their callbacks.
+ *
+ * @param[in] timeout
+ * Maximum time to wait in milliseconds, -1 to wait indefinitely.
+ *
+ * @retval >= 0
+ * Number of dispatched events.
+ *
+ * @retval < 0
+ * On error.
+ */
+int el_run_once(int timeout);
+
+#endif
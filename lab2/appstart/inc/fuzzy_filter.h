@@ -0,0 +1,112 @@
+#ifndef FUZZY_FILTER_H_
+#define FUZZY_FILTER_H_
+
+#include <stdint.h>
+
+#include "app_list.h"
+
+/* Longest query that is matched, longer ones are cut off. */
+#define FF_MAX_QUERY (64)
+
+/* Scores are clamped below this, so matches can be bucket sorted. */
+#define FF_MAX_SCORE (1024)
+
+/**
+ * @brief Matches of one query prefix. Names starting with the query are the
+ * contiguous catalog range [prefix_start, prefix_end) and come first, followed
+ * by the other names containing the query as a subsequence, best score first.
+ */
+struct ff_level
+{
+    int *matches;
+    int count;
+    int prefix_start;
+    int prefix_end;
+};
+
+/**
+ * @brief What matching needs of a catalog name, packed so scans stay in cache.
+ * The mask has one bit per character class present in the name, to skip most
+ * non-matching names without touching their strings.
+ */
+struct ff_name
+{
+    uint64_t mask;
+    const char *name;
+    size_t length;
+};
+
+/**
+ * @brief Incremental filter over a sorted catalog. The matches of every prefix
+ * of the current query are kept, so typing a character only rescans the
+ * matches of the previous one and deleting it is free.
+ */
+struct ff_filter
+{
+    const struct al_catalog *catalog;
+
+    struct ff_name *names;
+
+    /* Scratch space for scoring, one slot per catalog item. */
+    int *scores;
+    int *sorted;
+
+    char query[FF_MAX_QUERY];
+    int length;
+    struct ff_level levels[FF_MAX_QUERY];
+};
+
+/**
+ * @brief Initialize a filter with no catalog and an empty query.
+ */
+void ff_init(struct ff_filter *filter);
+
+/**
+ * @brief Free all matches and scratch space.
+ */
+void ff_dispose(struct ff_filter *filter);
+
+/**
+ * @brief Filter another catalog, e.g. after it was rebuilt, and apply the
+ * current query to it again.
+ *
+ * @param[in] catalog
+ * Catalog to filter, may be NULL. Must stay alive until the next call.
+ *
+ * @return EXIT_SUCCESS on success, an error-code otherwise.
+ */
+int ff_set_catalog(struct ff_filter *filter, const struct al_catalog *catalog);
+
+/**
+ * @brief Change the query. Only the part after the common prefix with the
+ * previous query is matched again.
+ *
+ * @param[in] query
+ * C-string to match case sensitively. An empty query matches everything.
+ *
+ * @retval >= 0
+ * Number of matches.
+ *
+ * @retval < 0
+ * Out of memory, the filter keeps the longest prefix it could match.
+ */
+int ff_update(struct ff_filter *filter, const char *query);
+
+/**
+ * @brief Check whether the filter narrows the catalog at all.
+ */
+int ff_active(const struct ff_filter *filter);
+
+/**
+ * @brief Number of matches, the catalog size for an empty query.
+ */
+int ff_count(const struct ff_filter *filter);
+
+/**
+ * @brief Item at a position of the filtered view.
+ *
+ * @return The item or NULL if index is out of range.
+ */
+struct al_item *ff_at(const struct ff_filter *filter, int index);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* One bucket per power of two nanoseconds. */
+#define HG_BUCKETS (64)
+
+/**
+ * @brief Log2 histogram of durations in nanoseconds. Bucket i holds values in
+ * [2^(i-1), 2^i), bucket 0 holds zero.
+ */
+struct hg
+{
+    uint64_t buckets[HG_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+};
+
+/**
+ * @brief Reset a histogram to empty.
+ */
+void hg_init(struct hg *hg);
+
+/**
+ * @brief Record one duration.
+ */
+void hg_add(struct hg *hg, uint64_t ns);
+
+/**
+ * @brief Approximate percentile as the upper bound of the bucket it falls in,
+ * clamped to the largest recorded value.
+ *
+ * @param[in] percentile
+ * Percentile between 0 and 100.
+ */
+uint64_t hg_percentile(const struct hg *hg, double percentile);
+
+/**
+ * @brief Print a compact summary like "n=12 p50=128us p99=1.0ms max=1.3ms".
+ *
+ * @return Number of characters that would have been written, see snprintf.
+ */
+int hg_format(const struct hg *hg, char *buffer, size_t length);
+
+/**
+ * @brief Print all non-empty buckets with a bar each.
+ */
+void hg_dump(const struct hg *hg, const char *title, FILE *file);
+
+#endif
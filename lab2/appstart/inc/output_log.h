@@ -0,0 +1,141 @@
+#ifndef OUTPUT_LOG_H_
+#define OUTPUT_LOG_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Bytes of a log file mapped at a time. Only this much of a log can be
+ * resident in appstart, however much the instance writes. */
+#define OL_WINDOW_SIZE (256 * 1024)
+
+/* Default size at which a log is rotated. */
+#define OL_ROTATE_SIZE (8 * 1024 * 1024)
+
+/* Rotated logs kept next to the current one, as path.1 (newest) to path.N. */
+#define OL_KEEP (3)
+
+/**
+ * @brief Append-only log file written through a shared mapping. The file is
+ * extended a window at a time and writes are plain copies into the window,
+ * so appending never blocks on a write syscall. Once a log reaches its
+ * rotation size it is renamed to path.1 and a new file is started.
+ */
+struct ol_log
+{
+    char *path;
+    int fd;
+    off_t rotate_size;
+    unsigned long rotations;
+
+    /* Bytes written to the current file. */
+    off_t length;
+
+    /* Mapped part of the current file, NULL until the first write. */
+    char *window;
+    off_t window_offset;
+};
+
+/**
+ * @brief Page through a log file with pread, without reading all of it. Only
+ * the first length bytes are shown, the rest of a file being written is not
+ * written yet, see ol_view_follow.
+ */
+struct ol_view
+{
+    int fd;
+    off_t offset;
+    off_t length;
+};
+
+/**
+ * @brief Initialize a closed log, so closing it is harmless.
+ */
+void ol_init(struct ol_log *log);
+
+/**
+ * @brief Create or truncate a log file.
+ *
+ * @param[in] rotate_size
+ * Size at which the log is rotated, at least one byte.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+ */
+int ol_open(struct ol_log *log, const char *path, off_t rotate_size);
+
+/**
+ * @brief Check whether the log is open.
+ */
+int ol_active(const struct ol_log *log);
+
+/**
+ * @brief Append bytes, rotating the log as often as needed.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file could not be
+ * extended or mapped. The log is closed then.
+ */
+int ol_write(struct ol_log *log, const char *buffer, size_t length);
+
+/**
+ * @brief Unmap the log and cut the file to the bytes written. The path stays
+ * set for viewing. Closing twice is harmless.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file could not be cut.
+ * It is closed anyway and ends in zeros then.
+ */
+int ol_close(struct ol_log *log);
+
+/**
+ * @brief Close the log and forget its path.
+ */
+void ol_dispose(struct ol_log *log);
+
+/**
+ * @brief Open the current file of a log for viewing, at its start.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+ */
+int ol_view_open(struct ol_view *view, const struct ol_log *log);
+
+/**
+ * @brief Show as much of the viewed file as is written. While log still
+ * writes to it, that is the length written so far, otherwise the file is
+ * complete.
+ *
+ * @param[in] log
+ * Log the view was opened for, NULL once it is gone.
+ */
+void ol_view_follow(struct ol_view *view, const struct ol_log *log);
+
+/**
+ * @brief Check whether a log file is being viewed.
+ */
+int ol_view_active(const struct ol_view *view);
+
+/**
+ * @brief Stop viewing. Closing twice is harmless.
+ */
+void ol_view_close(struct ol_view *view);
+
+/**
+ * @brief Read the page at the current offset, up to lines lines or length
+ * bytes.
+ *
+ * @return Number of bytes read, -1 on error.
+ */
+ssize_t ol_view_page(struct ol_view *view, char *buffer, size_t length, int lines);
+
+/**
+ * @brief Move forward by lines lines, reading a block at a time.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if nothing follows them.
+ */
+int ol_view_next(struct ol_view *view, int lines);
+
+/**
+ * @brief Move back by lines lines, reading backwards a block at a time.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE at the start of the log.
+ */
+int ol_view_previous(struct ol_view *view, int lines);
+
+#endif
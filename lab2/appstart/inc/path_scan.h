@@ -0,0 +1,61 @@
+#ifndef PATH_SCAN_H_
+#define PATH_SCAN_H_
+
+#include "app_list.h"
+
+/* Size of the getdents64 buffer per directory scan. */
+#define PS_DENTS_BUFFER_SIZE (256 * 1024)
+
+/**
+ * @brief Scan a list of directories for executables and add them to a
+ * catalog.
+ *
+ * Directory entries are read with large getdents64 buffers. Entries that are
+ * known not to be files by their d_type are skipped without a stat, only
+ * regular files, symlinks and entries of unknown type are checked with
+ * fstatat, which also drops dangling symlinks. A name found in several
+ * directories is only kept for the first directory in the list, just like
+ * PATH lookup would resolve it.
+ *
+ * @param[in] dirs
+ * Colon separated list of directories, e.g. the value of PATH. Empty entries
+ * are ignored.
+ *
+ * @param[in] threads
+ * Number of threads to scan directories in parallel with. Values <= 1 scan
+ * sequentially.
+ *
+ * @param[out] catalog
+ * Initialized, unfinished catalog. Will be finished on success.
+ *
+ * @retval >= 0
+ * Number of apps in the finished catalog.
+ *
+ * @retval < 0
+ * On error.
+ */
+int ps_scan(const char *dirs, int threads, struct al_catalog *catalog);
+
+/**
+ * @brief Create an al_item list of all executables in a colon separated list of
+ * directories, see ps_scan.
+ *
+ * @param[in] dirs
+ * Colon separated list of directories.
+ *
+ * @param[in] threads
+ * Number of threads to scan directories in parallel with.
+ *
+ * @param[out] apps
+ * Pointer to an al_item start pointer. Will point to the first item of the
+ * catalog on successful completion.
+ *
+ * @retval >= 0
+ * Number of al_items created.
+ *
+ * @retval < 0
+ * On error.
+ */
+int ps_search(const char *dirs, int threads, struct al_item **apps);
+
+#endif
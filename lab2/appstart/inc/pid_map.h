@@ -0,0 +1,58 @@
+#ifndef PID_MAP_H_
+#define PID_MAP_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Initial number of slots, always a power of two. */
+#define PM_INITIAL_CAPACITY (64)
+
+struct pm_entry
+{
+    pid_t pid;
+    void *value;
+};
+
+/**
+ * @brief Open-addressing hash table from pid to pointer. Linear probing with
+ * backward-shift deletion, so lookups never have to skip tombstones. Kept at
+ * most half full. Pid 0 marks an empty slot.
+ */
+struct pm
+{
+    struct pm_entry *entries;
+    size_t capacity;
+    size_t count;
+};
+
+/**
+ * @brief Initialize an empty map. Slots are allocated on the first insert.
+ */
+void pm_init(struct pm *map);
+
+/**
+ * @brief Free all slots.
+ */
+void pm_dispose(struct pm *map);
+
+/**
+ * @brief Map a pid to a value, replacing an existing mapping of the pid.
+ *
+ * @return EXIT_SUCCESS on success, an error-code otherwise.
+ */
+int pm_put(struct pm *map, pid_t pid, void *value);
+
+/**
+ * @brief Look up a pid.
+ *
+ * @return The mapped value or NULL.
+ */
+void *pm_get(const struct pm *map, pid_t pid);
+
+/**
+ * @brief Remove the mapping of a pid, but only if it still maps to the given
+ * value, since the pid may have been reused and remapped in the meantime.
+ */
+void pm_remove(struct pm *map, pid_t pid, const void *value);
+
+#endif
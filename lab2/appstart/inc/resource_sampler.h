@@ -0,0 +1,89 @@
+#ifndef RESOURCE_SAMPLER_H_
+#define RESOURCE_SAMPLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+/* Default time between two samples of every instance. */
+#define RS_INTERVAL_MS (1000)
+
+/* Share of the open file limit the sampler may keep open across samples.
+ * Beyond it, /proc files are opened for each sample instead. */
+#define RS_FD_SHARE (4)
+
+/**
+ * @brief Resource usage of one process as of its last sample. CPU time and
+ * resident memory come from /proc/<pid>/stat, I/O from /proc/<pid>/io. Both
+ * files stay open between samples and are read with pread.
+ */
+struct rs_usage
+{
+    pid_t pid;
+    int attached;
+    int stat_fd;
+    int io_fd;
+
+    /* Number of samples taken, cpu_percent needs at least two. */
+    unsigned long samples;
+    struct timespec sampled;
+    uint64_t cpu_ticks;
+    double cpu_percent;
+    uint64_t rss_bytes;
+
+    /* Bytes passed to read- and write-like syscalls (rchar, wchar). */
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+
+    struct rs_usage *next;
+    struct rs_usage *previous;
+};
+
+/**
+ * @brief Callback invoked after all attached processes were sampled.
+ */
+typedef void (*rs_callback)(void *data);
+
+/**
+ * @brief Sample all attached processes periodically from the event loop.
+ *
+ * @param[in] interval_ms
+ * Time between two samples in milliseconds.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+ */
+int rs_start(int interval_ms, rs_callback callback, void *data);
+
+/**
+ * @brief Stop sampling. Attached processes stay attached.
+ */
+void rs_stop(void);
+
+/**
+ * @brief Start sampling a process. The /proc files are opened on the first
+ * sample.
+ */
+void rs_attach(struct rs_usage *usage, pid_t pid);
+
+/**
+ * @brief Stop sampling a process and close its files. The last sample stays
+ * readable. Detaching twice is harmless.
+ */
+void rs_detach(struct rs_usage *usage);
+
+/**
+ * @brief Sample one process now.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the process is gone.
+ */
+int rs_sample(struct rs_usage *usage);
+
+/**
+ * @brief Print a compact summary like "2.5% 14M r1.2M w64K".
+ *
+ * @return Number of characters that would have been written, see snprintf.
+ */
+int rs_format(const struct rs_usage *usage, char *buffer, size_t length);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+
+#include <stddef.h>
+
+/**
+ * @brief Bounded byte ring. Writing to a full ring overwrites the oldest
+ * bytes, so the ring always holds the most recent output.
+ */
+struct rb
+{
+    char *data;
+    size_t size;
+    size_t head;
+    size_t length;
+    size_t dropped;
+};
+
+/**
+ * @brief Initialize a ring buffer. The storage is allocated lazily on the
+ * first write, so idle rings do not cost memory.
+ *
+ * @param[out] rb
+ * Ring to initialize.
+ *
+ * @param[in] size
+ * Capacity in bytes.
+ */
+void rb_init(struct rb *rb, size_t size);
+
+/**
+ * @brief Free the storage of a ring buffer.
+ */
+void rb_dispose(struct rb *rb);
+
+/**
+ * @brief Append bytes to the ring, overwriting the oldest bytes if necessary.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the storage could not be
+ * allocated.
+ */
+int rb_write(struct rb *rb, const char *buffer, size_t length);
+
+/**
+ * @brief Copy bytes out of the ring without consuming them.
+ *
+ * @param[in] rb
+ * Ring to read from.
+ *
+ * @param[in] offset
+ * Logical offset from the oldest byte in the ring.
+ *
+ * @param[out] buffer
+ * Destination buffer.
+ *
+ * @param[in] length
+ * Maximum number of bytes to copy.
+ *
+ * @return Number of bytes copied.
+ */
+size_t rb_peek(const struct rb *rb, size_t offset, char *buffer, size_t length);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef ZYGOTE_H_
+#define ZYGOTE_H_
+
+#include <stdint.h>
+#include <unistd.h>
+
+/* Pipe pairs the helper keeps ready for upcoming launches. */
+#define ZY_POOL_SIZE (8)
+
+/* Requests that may be sent before the first reply is received. */
+#define ZY_MAX_IN_FLIGHT (16)
+
+/**
+ * @brief Callback invoked after the helper exited on its own, e.g. crashed,
+ * with its wait status.
+ */
+typedef void (*zy_exit_callback)(int status, void *data);
+
+/**
+ * @brief Fork the launcher helper. Should be called as early as possible, while
+ * the process is still small, since the helper keeps a copy of it.
+ *
+ * The helper spawns apps on request with a vfork-style clone that makes them
+ * children of the calling process, so they are reaped like forked ones. The
+ * read ends of their stdout and stderr pipes are passed back with SCM_RIGHTS.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+ */
+int zy_start(void);
+
+/**
+ * @brief Check whether the launcher helper is running.
+ */
+int zy_active(void);
+
+/**
+ * @brief Pid of the launcher helper, -1 if it is not running. It is a child
+ * of the calling process, but no instance and no orphan of one, see zy_reap.
+ */
+pid_t zy_pid(void);
+
+/**
+ * @brief Set the callback for an exit of the helper other than by zy_stop.
+ * Launches fall back to fork after such an exit.
+ */
+void zy_watch_exit(zy_exit_callback callback, void *data);
+
+/**
+ * @brief Reap the helper if it exited and invoke the exit callback. For
+ * whoever reaps the children of the calling process, see al_watch_exits.
+ *
+ * @return EXIT_SUCCESS if the helper was reaped, EXIT_FAILURE otherwise.
+ */
+int zy_reap(void);
+
+/**
+ * @brief Ask the helper to spawn an app. Replies arrive in request order, see
+ * zy_receive. At most ZY_MAX_IN_FLIGHT requests may be outstanding.
+ *
+ * @param[in] path
+ * Path of the executable.
+ *
+ * @param[in] name
+ * argv[0] of the new process.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+ */
+int zy_request(const char *path, const char *name);
+
+/**
+ * @brief Receive the reply to the oldest outstanding request.
+ *
+ * @param[out] stdout_fd
+ * Read end of the new process' stdout pipe.
+ *
+ * @param[out] stderr_fd
+ * Read end of the new process' stderr pipe.
+ *
+ * @param[out] fork_ns
+ * Time the helper took until the new process ran.
+ *
+ * @param[out] exec_ns
+ * Time the new process took until execl succeeded.
+ *
+ * @retval > 0
+ * Pid of the new process.
+ *
+ * @retval < 0
+ * On error, errno is set. A process that failed to exec is reaped already.
+ */
+pid_t zy_receive(int *stdout_fd, int *stderr_fd, uint64_t *fork_ns, uint64_t *exec_ns);
+
+/**
+ * @brief Shut the helper down and wait for it.
+ */
+void zy_stop(void);
+
+#endif
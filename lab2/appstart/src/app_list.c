@@ -1,14 +1,130 @@
+#define _GNU_SOURCE
 #include "app_list.h"
+#include "cgroup.h"
+#include "event_loop.h"
+#include "pid_map.h"
+#include "zygote.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <limits.h>
 #include <string.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <signal.h>
 
+/* Upper bound of reads per wake-up, so one chatty instance cannot starve the
+ * others; the level-triggered event loop will come back for the rest. */
+#define DRAIN_READS_PER_EVENT (16)
+#define DRAIN_CHUNK_SIZE (4096)
+
+/* Events per epoll_wait and poll interval of al_wait_closing if there is no
+ * file descriptor to wait on for some instance. */
+#define WAIT_EVENTS (64)
+#define WAIT_POLL_MS (10)
+
+/* Milliseconds the processes killed in an instance cgroup get to leave it,
+ * when the instance is freed and, for stragglers, when exits are no longer
+ * watched. */
+#define CGROUP_FREE_WAIT_MS (50)
+#define CGROUP_QUIT_WAIT_MS (1000)
+
+/* Exit tracking, set up by al_watch_exits. */
+static int watching_exits = 0;
+static int use_pidfd = 0;
+static int sigchld_fd = -1;
+static struct el_handler *sigchld_handler = NULL;
+static al_exit_callback exit_callback = NULL;
+static void *exit_data = NULL;
+
+/* Closed instances waiting to be reaped. */
+static struct al_instance *closing = NULL;
+
+/* Cgroups of freed instances that could not be removed yet. */
+static char **stale_cgroups = NULL;
+static int stale_count = 0;
+
+/* Every instance by pid. Exited ones stay until freed or their pid is reused. */
+static struct pm instances_by_pid = {NULL, 0, 0};
+
+static struct al_launch_timings launch_timings = {0};
+
+/* Milliseconds closed instances get before SIGKILL, see al_set_close_grace. */
+static int close_grace = AL_CLOSE_GRACE_MS;
+
+/* Where instance output is spooled to, see al_set_log_dir. */
+static const char *log_dir = NULL;
+static off_t log_rotate_size = OL_ROTATE_SIZE;
+
+static int64_t al_elapsed_ns(const struct timespec *from)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - from->tv_sec) * 1000000000LL + now.tv_nsec - from->tv_nsec;
+}
+
+static void al_close_output(struct al_instance *instance, int fd)
+{
+    if (fd == instance->stdout)
+    {
+        el_remove(instance->stdout_handler);
+        instance->stdout_handler = NULL;
+        instance->stdout = -1;
+    }
+    else if (fd == instance->stderr)
+    {
+        el_remove(instance->stderr_handler);
+        instance->stderr_handler = NULL;
+        instance->stderr = -1;
+    }
+    close(fd);
+
+    /* Nothing more to log, cut the file to what was written. */
+    if (instance->stdout < 0 && instance->stderr < 0)
+        ol_close(&instance->log);
+}
+
+static void al_drain_output(struct el_handler *handler, int fd, uint32_t events, void *data)
+{
+    struct al_instance *instance = data;
+    char buffer[DRAIN_CHUNK_SIZE];
+
+    for (int i = 0; i < DRAIN_READS_PER_EVENT; i++)
+    {
+        ssize_t nread = read(fd, buffer, sizeof(buffer));
+        if (nread > 0)
+        {
+            if (instance->first_output_ns < 0)
+            {
+                instance->first_output_ns = al_elapsed_ns(&instance->launched);
+                hg_add(&launch_timings.first_output, instance->first_output_ns);
+            }
+            rb_write(&instance->output, buffer, nread);
+            if (ol_active(&instance->log))
+                ol_write(&instance->log, buffer, nread);
+            continue;
+        }
+        if (nread < 0 && errno == EINTR)
+            continue;
+        if (nread < 0 && errno == EAGAIN)
+            return;
+
+        /* EOF or error: the instance closed its end of the pipe. */
+        al_close_output(instance, fd);
+        return;
+    }
+}
+
 int al_create(struct al_item **apps, const char *dir, const char *name, struct al_item *next, struct al_item *previous)
 {
     int dirlen = 0;
@@ -28,10 +144,16 @@ int al_create(struct al_item **apps, const char *dir, const char *name, struct a
         _name = path + dirlen + 1;
         strcat(strcat(strcpy(path, dir), "/"), name);
     }
+    else
+    {
+        strcpy(path, name);
+    }
 
     (*apps)->path = path;
     (*apps)->name = _name;
     (*apps)->instances = NULL;
+    (*apps)->catalog = NULL;
+    (*apps)->index = 0;
     (*apps)->next = next;
     (*apps)->previous = previous;
     return EXIT_SUCCESS;
@@ -46,14 +168,611 @@ void al_dispose(struct al_item *app)
     if (app->previous != NULL)
         app->previous->next = app->next;
 
+    if (app->catalog != NULL)
+    {
+        struct al_catalog *catalog = app->catalog;
+        if (--catalog->live == 0)
+        {
+            al_catalog_dispose(catalog);
+            free(catalog);
+        }
+        return;
+    }
+
+    free(app->path);
     free(app);
 }
 
-struct al_instance *al_create_instance(struct al_item *app)
+void al_catalog_init(struct al_catalog *catalog)
 {
-    int stdout_link[2] = {-1, -1};
-    int stderr_link[2] = {-1, -1};
+    memset(catalog, 0, sizeof(struct al_catalog));
+}
+
+int al_catalog_add(struct al_catalog *catalog, const char *dir, const char *name)
+{
+    size_t dirlen = dir != NULL ? strlen(dir) + 1 : 0;
+    size_t namelen = strlen(name) + 1;
+
+    /* Entries are stored as "dir/name\0" preceded by the name's offset, so the
+     * name can be found again after sorting and compacting. */
+    size_t needed = sizeof(size_t) + dirlen + namelen;
+    if (catalog->pool_length + needed > catalog->pool_capacity)
+    {
+        size_t capacity = catalog->pool_capacity > 0 ? catalog->pool_capacity * 2 : 64 * 1024;
+        while (capacity < catalog->pool_length + needed)
+            capacity *= 2;
+        char *pool = realloc(catalog->pool, capacity);
+        if (pool == NULL)
+            return EXIT_FAILURE;
+        catalog->pool = pool;
+        catalog->pool_capacity = capacity;
+    }
+    if (catalog->count == catalog->pending_capacity)
+    {
+        int capacity = catalog->pending_capacity > 0 ? catalog->pending_capacity * 2 : 1024;
+        size_t *pending = realloc(catalog->pending, capacity * sizeof(size_t));
+        if (pending == NULL)
+            return EXIT_FAILURE;
+        catalog->pending = pending;
+        catalog->pending_capacity = capacity;
+    }
+
+    char *entry = catalog->pool + catalog->pool_length;
+    memcpy(entry, &dirlen, sizeof(size_t));
+    if (dir != NULL)
+    {
+        memcpy(entry + sizeof(size_t), dir, dirlen - 1);
+        entry[sizeof(size_t) + dirlen - 1] = '/';
+    }
+    memcpy(entry + sizeof(size_t) + dirlen, name, namelen);
+
+    catalog->pending[catalog->count++] = catalog->pool_length;
+    catalog->pool_length += needed;
+    return EXIT_SUCCESS;
+}
+
+int al_catalog_add_item(struct al_catalog *catalog, const struct al_item *item)
+{
+    size_t dirlen = item->name - item->path;
+    if (dirlen == 0)
+        return al_catalog_add(catalog, NULL, item->name);
+
+    /* Drop the separator, al_catalog_add puts it back. */
+    char dir[dirlen];
+    memcpy(dir, item->path, dirlen - 1);
+    dir[dirlen - 1] = '\0';
+    return al_catalog_add(catalog, dir, item->name);
+}
+
+static int al_catalog_compare(const void *a, const void *b, void *arg)
+{
+    const char *pool = arg;
+    const char *entry_a = pool + *(const size_t *)a;
+    const char *entry_b = pool + *(const size_t *)b;
+    size_t dirlen_a;
+    size_t dirlen_b;
+    memcpy(&dirlen_a, entry_a, sizeof(size_t));
+    memcpy(&dirlen_b, entry_b, sizeof(size_t));
+    int order = strcmp(entry_a + sizeof(size_t) + dirlen_a, entry_b + sizeof(size_t) + dirlen_b);
+    if (order != 0)
+        return order;
+    /* Equal names keep the order they were added in. */
+    return entry_a < entry_b ? -1 : entry_a > entry_b;
+}
+
+static const char *al_catalog_name(const struct al_catalog *catalog, int index)
+{
+    const char *entry = catalog->pool + catalog->pending[index];
+    size_t dirlen;
+    memcpy(&dirlen, entry, sizeof(size_t));
+    return entry + sizeof(size_t) + dirlen;
+}
+
+static void al_catalog_link(struct al_catalog *catalog, struct al_item *items)
+{
+    for (int i = 0; i < catalog->count; i++)
+    {
+        items[i].instances = NULL;
+        items[i].catalog = catalog;
+        items[i].index = i;
+        items[i].next = i + 1 < catalog->count ? &items[i + 1] : NULL;
+        items[i].previous = i > 0 ? &items[i - 1] : NULL;
+    }
+    catalog->items = items;
+    catalog->live = catalog->count;
+}
+
+int al_catalog_finish(struct al_catalog *catalog)
+{
+    qsort_r(catalog->pending, catalog->count, sizeof(size_t), al_catalog_compare, catalog->pool);
+
+    /* Only the first added entry of a name survives. */
+    int unique = 0;
+    for (int i = 0; i < catalog->count; i++)
+        if (unique == 0 || strcmp(al_catalog_name(catalog, unique - 1), al_catalog_name(catalog, i)) != 0)
+            catalog->pending[unique++] = catalog->pending[i];
+    catalog->count = unique;
+
+    /* Compact the pool in sorted order, dropping the offset prefixes. */
+    size_t pool_length = 0;
+    for (int i = 0; i < catalog->count; i++)
+        pool_length += strlen(catalog->pool + catalog->pending[i] + sizeof(size_t)) + 1;
+    char *pool = malloc(pool_length > 0 ? pool_length : 1);
+    struct al_item *items = malloc((catalog->count > 0 ? catalog->count : 1) * sizeof(struct al_item));
+    if (pool == NULL || items == NULL)
+    {
+        free(pool);
+        free(items);
+        return EXIT_FAILURE;
+    }
+
+    char *dst = pool;
+    for (int i = 0; i < catalog->count; i++)
+    {
+        const char *entry = catalog->pool + catalog->pending[i];
+        size_t dirlen;
+        memcpy(&dirlen, entry, sizeof(size_t));
+        size_t length = dirlen + strlen(entry + sizeof(size_t) + dirlen) + 1;
+        memcpy(dst, entry + sizeof(size_t), length);
+
+        items[i].path = dst;
+        items[i].name = dst + dirlen;
+        dst += length;
+    }
+
+    free(catalog->pool);
+    free(catalog->pending);
+    catalog->pending = NULL;
+    catalog->pending_capacity = 0;
+    catalog->pool = pool;
+    catalog->pool_length = pool_length;
+    catalog->pool_capacity = pool_length;
+    al_catalog_link(catalog, items);
+    return EXIT_SUCCESS;
+}
+
+int al_catalog_map(struct al_catalog *catalog, const char *pool, size_t pool_length,
+                   const struct al_catalog_entry *entries, int count,
+                   void *mapping, size_t mapping_length)
+{
+    struct al_item *items = malloc((count > 0 ? count : 1) * sizeof(struct al_item));
+    if (items == NULL)
+        return EXIT_FAILURE;
+
+    for (int i = 0; i < count; i++)
+    {
+        items[i].path = (char *)pool + entries[i].path;
+        items[i].name = (char *)pool + entries[i].name;
+    }
+
+    catalog->count = count;
+    catalog->pool = (char *)pool;
+    catalog->pool_length = pool_length;
+    catalog->pool_capacity = 0;
+    catalog->mapping = mapping;
+    catalog->mapping_length = mapping_length;
+    al_catalog_link(catalog, items);
+    return EXIT_SUCCESS;
+}
+
+void al_catalog_dispose(struct al_catalog *catalog)
+{
+    if (catalog->items != NULL)
+        for (int i = 0; i < catalog->count; i++)
+            al_close_instances(&catalog->items[i]);
+    free(catalog->items);
+    if (catalog->mapping != NULL)
+        munmap(catalog->mapping, catalog->mapping_length);
+    else
+        free(catalog->pool);
+    free(catalog->pending);
+    al_catalog_init(catalog);
+}
+
+struct al_item *al_catalog_at(const struct al_catalog *catalog, int index)
+{
+    if (catalog->items == NULL || index < 0 || index >= catalog->count)
+        return NULL;
+    return &catalog->items[index];
+}
+
+int al_catalog_find(const struct al_catalog *catalog, const char *name)
+{
+    int low = 0;
+    int high = catalog->items != NULL ? catalog->count - 1 : -1;
+    while (low <= high)
+    {
+        int mid = low + (high - low) / 2;
+        int order = strcmp(catalog->items[mid].name, name);
+        if (order == 0)
+            return mid;
+        if (order < 0)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+    return -1;
+}
+
+void al_catalog_migrate(struct al_catalog *from, struct al_catalog *to)
+{
+    for (int i = 0; i < from->count; i++)
+    {
+        struct al_item *app = &from->items[i];
+        if (app->instances == NULL)
+            continue;
+        int index = al_catalog_find(to, app->name);
+        if (index < 0)
+            continue;
+
+        struct al_item *target = &to->items[index];
+        target->instances = app->instances;
+        app->instances = NULL;
+        for (struct al_instance *instance = target->instances; instance != NULL; instance = instance->next)
+            instance->app = target;
+    }
+}
+
+/* Remove an instance cgroup, or keep it for al_retry_cgroups while killed
+ * processes are still in it. Takes over path. */
+static void al_remove_cgroup(char *path, int timeout)
+{
+    if (cg_remove(path, timeout) == EXIT_SUCCESS)
+    {
+        free(path);
+        return;
+    }
+    char **grown = realloc(stale_cgroups, (stale_count + 1) * sizeof(*stale_cgroups));
+    if (grown == NULL)
+    {
+        free(path);
+        return;
+    }
+    stale_cgroups = grown;
+    stale_cgroups[stale_count++] = path;
+}
+
+static void al_retry_cgroups(int timeout)
+{
+    int kept = 0;
+    for (int i = 0; i < stale_count; i++)
+    {
+        if (cg_remove(stale_cgroups[i], timeout) == EXIT_SUCCESS)
+            free(stale_cgroups[i]);
+        else
+            stale_cgroups[kept++] = stale_cgroups[i];
+    }
+    stale_count = kept;
+    if (stale_count == 0)
+    {
+        free(stale_cgroups);
+        stale_cgroups = NULL;
+    }
+}
+
+static void al_free_instance(struct al_instance *instance)
+{
+    if (instance->stdout > -1)
+        al_close_output(instance, instance->stdout);
+    if (instance->stderr > -1)
+        al_close_output(instance, instance->stderr);
+    rb_dispose(&instance->output);
+    ol_dispose(&instance->log);
+    rs_detach(&instance->usage);
+    if (instance->cgroup != NULL)
+        al_remove_cgroup(instance->cgroup, CGROUP_FREE_WAIT_MS);
+    pm_remove(&instances_by_pid, instance->pid, instance);
+    if (instances_by_pid.count == 0)
+        pm_dispose(&instances_by_pid);
+    free(instance);
+}
+
+/* Signal the process group of an instance, which holds its descendants unless
+ * they moved to a group of their own, and the instance itself in case it did.
+ * Only until it is reaped, see al_collect. */
+static void al_signal(struct al_instance *instance, int signal)
+{
+    if (instance->exited)
+        return;
+    kill(-instance->pid, signal);
+    kill(instance->pid, signal);
+}
+
+static void al_reap(struct al_instance *instance, int status)
+{
+    instance->exited = 1;
+    instance->status = status;
+    clock_gettime(CLOCK_MONOTONIC, &instance->ended);
+    rs_detach(&instance->usage);
 
+    if (instance->exit_handler != NULL)
+    {
+        el_remove(instance->exit_handler);
+        instance->exit_handler = NULL;
+    }
+    if (instance->pidfd > -1)
+    {
+        close(instance->pidfd);
+        instance->pidfd = -1;
+    }
+
+    if (!instance->closing)
+    {
+        if (exit_callback != NULL)
+            exit_callback(instance, exit_data);
+        return;
+    }
+
+    if (instance->next != NULL)
+        instance->next->previous = instance->previous;
+    if (instance->previous != NULL)
+        instance->previous->next = instance->next;
+    else if (closing == instance)
+        closing = instance->next;
+
+    al_free_instance(instance);
+}
+
+/* Reap an instance if it exited. Nothing is left to wait on for descendants
+ * of a closed instance, so its process group is killed first, while the
+ * zombie still holds the group id; once it is reaped and the last member is
+ * gone, the id may be reused by any process. */
+static void al_collect(struct al_instance *instance)
+{
+    siginfo_t child;
+    int status = 0;
+
+    child.si_pid = 0;
+    if (waitid(P_PID, instance->pid, &child, WEXITED | WNOHANG | WNOWAIT) == 0)
+    {
+        if (child.si_pid == 0)
+            return;
+        if (instance->closing)
+            kill(-instance->pid, SIGKILL);
+    }
+    pid_t pid = waitpid(instance->pid, &status, WNOHANG);
+    if (pid == 0)
+        return;
+    al_reap(instance, pid == instance->pid ? status : 0);
+}
+
+static void al_on_pidfd(struct el_handler *handler, int fd, uint32_t events, void *data)
+{
+    al_collect(data);
+}
+
+/* Account a reparented descendant to the instance whose group it is in. */
+static void al_reap_orphan(pid_t pid)
+{
+    /* The group is only known while the orphan is a zombie. */
+    pid_t group = getpgid(pid);
+    struct rusage usage;
+    int status;
+    if (wait4(pid, &status, 0, &usage) != pid)
+        return;
+
+    struct al_instance *instance = group > 0 ? al_find_instance(group) : NULL;
+    if (instance == NULL)
+        return;
+    instance->orphans++;
+    instance->orphan_cpu += usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                            (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void al_reap_children(int fd)
+{
+    struct signalfd_siginfo info[16];
+    siginfo_t child;
+
+    /* SIGCHLD is not queued per child, so reap everything that exited. Peek
+     * first, orphans have to be accounted before they are gone. */
+    while (read(fd, info, sizeof(info)) > 0)
+        ;
+    while (1)
+    {
+        child.si_pid = 0;
+        if (waitid(P_ALL, 0, &child, WEXITED | WNOHANG | WNOWAIT) != 0 || child.si_pid == 0)
+            break;
+
+        /* The launcher helper is a child, but no instance of anything. */
+        if (child.si_pid == zy_pid() && zy_reap() == EXIT_SUCCESS)
+            continue;
+
+        struct al_instance *instance = al_find_instance(child.si_pid);
+        if (instance == NULL || instance->exited)
+        {
+            al_reap_orphan(child.si_pid);
+            continue;
+        }
+        al_collect(instance);
+    }
+
+    /* Killed processes leaving a cgroup are reparented here, so retry. */
+    if (stale_count > 0)
+        al_retry_cgroups(0);
+}
+
+static void al_on_sigchld(struct el_handler *handler, int fd, uint32_t events, void *data)
+{
+    al_reap_children(fd);
+}
+
+int al_watch_exits(al_exit_callback callback, void *data)
+{
+    if (!el_active())
+        return EXIT_FAILURE;
+    exit_callback = callback;
+    exit_data = data;
+    if (watching_exits)
+        return EXIT_SUCCESS;
+
+    /* Descendants of exited instances are reparented to appstart instead of
+     * init, so SIGCHLD has to be watched even when instances have pidfds. */
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+#ifdef SYS_pidfd_open
+    int fd = syscall(SYS_pidfd_open, getpid(), 0);
+    if (fd > -1)
+    {
+        close(fd);
+        use_pidfd = 1;
+    }
+#endif
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0)
+        return EXIT_FAILURE;
+    sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigchld_fd < 0)
+        return EXIT_FAILURE;
+    sigchld_handler = el_add(sigchld_fd, EPOLLIN, al_on_sigchld, NULL);
+    if (sigchld_handler == NULL)
+    {
+        close(sigchld_fd);
+        sigchld_fd = -1;
+        return EXIT_FAILURE;
+    }
+    watching_exits = 1;
+    return EXIT_SUCCESS;
+}
+
+void al_set_close_grace(int milliseconds)
+{
+    close_grace = milliseconds;
+}
+
+void al_set_log_dir(const char *dir, off_t rotate_size)
+{
+    log_dir = dir;
+    log_rotate_size = rotate_size;
+}
+
+static long long al_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+void al_wait_closing(void)
+{
+    struct epoll_event events[WAIT_EVENTS];
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int polling = epoll_fd < 0;
+
+    /* One epoll set for all of them, so the slowest one bounds the wait. */
+    for (struct al_instance *instance = closing; instance != NULL && !polling; instance = instance->next)
+    {
+#ifdef SYS_pidfd_open
+        if (instance->pidfd < 0)
+            instance->pidfd = syscall(SYS_pidfd_open, instance->pid, 0);
+#endif
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = instance};
+        if (instance->pidfd > -1 && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, instance->pidfd, &event) == 0)
+            continue;
+        if (sigchld_fd < 0)
+            polling = 1;
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if (sigchld_fd > -1 && !polling && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sigchld_fd, &event) != 0)
+        polling = 1;
+
+    long long deadline = al_now_ms() + close_grace;
+    int killed = 0;
+    while (closing != NULL)
+    {
+        int timeout = -1;
+        if (!killed)
+        {
+            long long left = deadline - al_now_ms();
+            timeout = left > 0 ? (int)left : 0;
+        }
+        if (polling && (timeout < 0 || timeout > WAIT_POLL_MS))
+            timeout = WAIT_POLL_MS;
+
+        int count = 0;
+        if (epoll_fd > -1)
+            count = epoll_wait(epoll_fd, events, WAIT_EVENTS, timeout);
+        else
+            usleep(timeout * 1000);
+        if (count < 0 && errno != EINTR)
+            polling = 1;
+
+        for (int i = 0; i < count; i++)
+        {
+            struct al_instance *instance = events[i].data.ptr;
+            if (instance == NULL)
+                al_reap_children(sigchld_fd);
+            else
+                al_collect(instance);
+        }
+
+        if (polling)
+        {
+            struct al_instance *instance = closing;
+            while (instance != NULL)
+            {
+                struct al_instance *next = instance->next;
+                al_collect(instance);
+                instance = next;
+            }
+        }
+
+        if (!killed && closing != NULL && al_now_ms() >= deadline)
+        {
+            for (struct al_instance *instance = closing; instance != NULL; instance = instance->next)
+                al_signal(instance, SIGKILL);
+            killed = 1;
+        }
+    }
+
+    if (epoll_fd > -1)
+        close(epoll_fd);
+}
+
+void al_unwatch_exits(void)
+{
+    al_wait_closing();
+    al_retry_cgroups(CGROUP_QUIT_WAIT_MS);
+
+    if (sigchld_handler != NULL)
+    {
+        el_remove(sigchld_handler);
+        sigchld_handler = NULL;
+    }
+    if (sigchld_fd > -1)
+    {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        close(sigchld_fd);
+        sigchld_fd = -1;
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    }
+    prctl(PR_SET_CHILD_SUBREAPER, 0);
+    watching_exits = 0;
+    use_pidfd = 0;
+    exit_callback = NULL;
+    exit_data = NULL;
+}
+
+double al_instance_runtime(const struct al_instance *instance)
+{
+    struct timespec end;
+    if (instance->exited)
+        end = instance->ended;
+    else
+        clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - instance->started.tv_sec) + (end.tv_nsec - instance->started.tv_nsec) / 1e9;
+}
+
+/* Append a started process to the instances of an app and hook its output
+ * pipes and exit up to the event loop. */
+static struct al_instance *al_add_instance(struct al_item *app, pid_t pid, int stdout_fd, int stderr_fd,
+                                           const struct timespec *launched, int64_t fork_ns, int64_t exec_ns)
+{
     struct al_instance *prev = NULL;
     struct al_instance **cur = &app->instances;
     while (*cur != NULL)
@@ -64,68 +783,467 @@ struct al_instance *al_create_instance(struct al_item *app)
 
     *cur = malloc(sizeof(struct al_instance));
     if (*cur == NULL)
-        goto err;
+        return NULL;
+    if (pm_put(&instances_by_pid, pid, *cur) != EXIT_SUCCESS)
+    {
+        free(*cur);
+        *cur = NULL;
+        return NULL;
+    }
     (*cur)->app = app;
     (*cur)->next = NULL;
     (*cur)->previous = prev;
+    (*cur)->pid = pid;
+    (*cur)->stdout = stdout_fd;
+    (*cur)->stderr = stderr_fd;
 
-    if (pipe(stdout_link) != 0)
-        goto err;
+    rb_init(&(*cur)->output, AL_OUTPUT_BUFFER_SIZE);
+    ol_init(&(*cur)->log);
+    if (log_dir != NULL && (stdout_fd > -1 || stderr_fd > -1))
+    {
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof(path), "%s/%s.%d.log", log_dir, app->name, pid) < (int)sizeof(path))
+            ol_open(&(*cur)->log, path, log_rotate_size);
+    }
+    (*cur)->stdout_handler = NULL;
+    (*cur)->stderr_handler = NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &(*cur)->started);
+    (*cur)->launched = *launched;
+    (*cur)->fork_ns = fork_ns;
+    (*cur)->exec_ns = exec_ns;
+    (*cur)->first_output_ns = -1;
+    rs_attach(&(*cur)->usage, pid);
+    (*cur)->cgroup = NULL;
+    (*cur)->orphans = 0;
+    (*cur)->orphan_cpu = 0;
+    hg_add(&launch_timings.fork, fork_ns);
+    hg_add(&launch_timings.exec, exec_ns);
 
-    if (pipe(stderr_link) != 0)
+    (*cur)->pidfd = -1;
+    (*cur)->exit_handler = NULL;
+    (*cur)->exited = 0;
+    (*cur)->status = 0;
+    (*cur)->closing = 0;
+    (*cur)->watched = 0;
+    if (watching_exits)
+    {
+#ifdef SYS_pidfd_open
+        if (use_pidfd && ((*cur)->pidfd = syscall(SYS_pidfd_open, (*cur)->pid, 0)) > -1)
+        {
+            (*cur)->exit_handler = el_add((*cur)->pidfd, EPOLLIN, al_on_pidfd, *cur);
+            if ((*cur)->exit_handler == NULL)
+            {
+                close((*cur)->pidfd);
+                (*cur)->pidfd = -1;
+            }
+        }
+#endif
+        /* Without a pidfd handler only SIGCHLD can tell about the exit. */
+        (*cur)->watched = (*cur)->exit_handler != NULL || !use_pidfd;
+    }
+    if (el_active())
+    {
+        fcntl((*cur)->stdout, F_SETFL, fcntl((*cur)->stdout, F_GETFL) | O_NONBLOCK);
+        fcntl((*cur)->stderr, F_SETFL, fcntl((*cur)->stderr, F_GETFL) | O_NONBLOCK);
+        (*cur)->stdout_handler = el_add((*cur)->stdout, EPOLLIN, al_drain_output, *cur);
+        (*cur)->stderr_handler = el_add((*cur)->stderr, EPOLLIN, al_drain_output, *cur);
+    }
+    return *cur;
+}
+
+/* Kill a process that could not be added to its app, so it does not linger. */
+static void al_abandon(pid_t pid, int stdout_fd, int stderr_fd)
+{
+    close(stdout_fd);
+    close(stderr_fd);
+    kill(-pid, SIGKILL);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+static struct al_instance *al_receive_instance(struct al_item *app, const struct timespec *launched)
+{
+    int stdout_fd;
+    int stderr_fd;
+    uint64_t fork_ns;
+    uint64_t exec_ns;
+    pid_t pid = zy_receive(&stdout_fd, &stderr_fd, &fork_ns, &exec_ns);
+    if (pid < 0)
+        return NULL;
+
+    struct al_instance *instance = al_add_instance(app, pid, stdout_fd, stderr_fd, launched, fork_ns, exec_ns);
+    if (instance == NULL)
+        al_abandon(pid, stdout_fd, stderr_fd);
+    return instance;
+}
+
+struct al_instance *al_find_instance(pid_t pid)
+{
+    return pm_get(&instances_by_pid, pid);
+}
+
+const struct al_launch_timings *al_get_launch_timings(void)
+{
+    return &launch_timings;
+}
+
+void al_init_launch_options(struct al_launch_options *options)
+{
+    memset(options, 0, sizeof(struct al_launch_options));
+    options->policy = -1;
+    options->address_space = RLIM_INFINITY;
+    options->open_files = RLIM_INFINITY;
+}
+
+/* A number with an optional K, M or G suffix. */
+static int al_parse_size(const char *text, rlim_t *size)
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0 || end == text)
+        return EXIT_FAILURE;
+    switch (*end)
+    {
+    case 'G':
+        value *= 1024;
+        /* fall through */
+    case 'M':
+        value *= 1024;
+        /* fall through */
+    case 'K':
+        value *= 1024;
+        end++;
+        break;
+    }
+    *size = value;
+    return *end == '\0' ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int al_parse_launch_option(struct al_launch_options *options, const char *option)
+{
+    const char *value = strchr(option, '=');
+    if (value == NULL)
+        return EXIT_FAILURE;
+    size_t key = value++ - option;
+    char *end;
+    rlim_t size;
+
+    if (key == 4 && strncmp(option, "cpus", key) == 0)
+    {
+        CPU_ZERO(&options->cpus);
+        options->cpu_count = 0;
+        while (*value != '\0')
+        {
+            long first = strtol(value, &end, 10);
+            long last = first;
+            if (end == value || first < 0)
+                return EXIT_FAILURE;
+            if (*end == '-')
+            {
+                value = end + 1;
+                last = strtol(value, &end, 10);
+                if (end == value || last < first)
+                    return EXIT_FAILURE;
+            }
+            for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+                CPU_SET(cpu, &options->cpus);
+            if (*end == ',')
+                end++;
+            else if (*end != '\0')
+                return EXIT_FAILURE;
+            value = end;
+        }
+        options->cpu_count = CPU_COUNT(&options->cpus);
+        return options->cpu_count > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (key == 4 && strncmp(option, "nice", key) == 0)
+    {
+        options->nice = strtol(value, &end, 10);
+        options->set_nice = 1;
+        return end != value && *end == '\0' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (key == 5 && strncmp(option, "sched", key) == 0)
+    {
+        static const struct
+        {
+            const char *name;
+            int policy;
+        } policies[] = {{"other", SCHED_OTHER}, {"batch", SCHED_BATCH}, {"idle", SCHED_IDLE},
+                        {"fifo", SCHED_FIFO},   {"rr", SCHED_RR}};
+        size_t length = strcspn(value, ":");
+        for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+        {
+            if (strlen(policies[i].name) != length || strncmp(value, policies[i].name, length) != 0)
+                continue;
+            /* Checked here, the child could only fail at launch. fifo and rr
+             * need a priority of at least 1, the others only take 0. */
+            int minimum = sched_get_priority_min(policies[i].policy);
+            int maximum = sched_get_priority_max(policies[i].policy);
+            long priority = 0;
+            if (value[length] == ':')
+            {
+                priority = strtol(value + length + 1, &end, 10);
+                if (end == value + length + 1 || *end != '\0')
+                    return EXIT_FAILURE;
+            }
+            if (minimum < 0 || priority < minimum || priority > maximum)
+                return EXIT_FAILURE;
+            options->policy = policies[i].policy;
+            options->priority = priority;
+            return EXIT_SUCCESS;
+        }
+        return EXIT_FAILURE;
+    }
+    if (key == 2 && strncmp(option, "as", key) == 0)
+        return al_parse_size(value, &options->address_space);
+    if (key == 6 && strncmp(option, "nofile", key) == 0)
+        return al_parse_size(value, &options->open_files);
+    if (key == 7 && strncmp(option, "cpu.max", key) == 0)
+    {
+        unsigned long quota;
+        unsigned long period = 100000;
+        int written;
+        if (strcmp(value, "max") == 0)
+            written = snprintf(options->cpu_max, sizeof(options->cpu_max), "max %lu", period);
+        else if (sscanf(value, "%lu/%lu", &quota, &period) == 2 && quota > 0 && period > 0)
+            written = snprintf(options->cpu_max, sizeof(options->cpu_max), "%lu %lu", quota, period);
+        else if (sscanf(value, "%lu%%", &quota) == 1 && quota > 0 && strchr(value, '%') != NULL)
+            written = snprintf(options->cpu_max, sizeof(options->cpu_max), "%lu %lu", quota * period / 100, period);
+        else
+            return EXIT_FAILURE;
+        /* A truncated value would still be accepted by cpu.max. */
+        if (written < 0 || written >= (int)sizeof(options->cpu_max))
+        {
+            options->cpu_max[0] = '\0';
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (key == 7 && strncmp(option, "mem.max", key) == 0)
+    {
+        if (al_parse_size(value, &size) != EXIT_SUCCESS || size == 0)
+            return EXIT_FAILURE;
+        options->memory_max = size;
+        return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
+
+static int al_wants_cgroup(const struct al_launch_options *options)
+{
+    return options != NULL && (options->cpu_max[0] != '\0' || options->memory_max > 0);
+}
+
+/* Runs in the forked child, so only plain syscalls. The cgroup comes first, so
+ * everything after runs within its limits. */
+static int al_apply_options(const struct al_launch_options *options, int procs_fd)
+{
+    if (procs_fd > -1 && write(procs_fd, "0", 1) != 1)
+        return EXIT_FAILURE;
+    if (options->cpu_count > 0 && sched_setaffinity(0, sizeof(cpu_set_t), &options->cpus) != 0)
+        return EXIT_FAILURE;
+    if (options->policy > -1)
+    {
+        struct sched_param param = {.sched_priority = options->priority};
+        if (sched_setscheduler(0, options->policy, &param) != 0)
+            return EXIT_FAILURE;
+    }
+    if (options->set_nice && setpriority(PRIO_PROCESS, 0, options->nice) != 0)
+        return EXIT_FAILURE;
+
+    struct rlimit limit;
+    if (options->address_space != RLIM_INFINITY)
+    {
+        limit.rlim_cur = limit.rlim_max = options->address_space;
+        if (setrlimit(RLIMIT_AS, &limit) != 0)
+            return EXIT_FAILURE;
+    }
+    if (options->open_files != RLIM_INFINITY)
+    {
+        limit.rlim_cur = limit.rlim_max = options->open_files;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+struct al_instance *al_create_instance(struct al_item *app)
+{
+    return al_create_instance_with_options(app, NULL);
+}
+
+struct al_instance *al_create_instance_with_options(struct al_item *app, const struct al_launch_options *options)
+{
+    int stdout_link[2] = {-1, -1};
+    int stderr_link[2] = {-1, -1};
+    int status_link[2] = {-1, -1};
+    int procs_fd = -1;
+    char cgroup[PATH_MAX] = "";
+    struct timespec launched;
+    int error = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &launched);
+    if (zy_active() && options == NULL)
+        return zy_request(app->path, app->name) == EXIT_SUCCESS ? al_receive_instance(app, &launched) : NULL;
+
+    if (al_wants_cgroup(options))
+    {
+        if (cg_create(options->cpu_max, options->memory_max, cgroup, sizeof(cgroup)) != EXIT_SUCCESS)
+        {
+            cgroup[0] = '\0';
+            goto err;
+        }
+        if ((procs_fd = cg_open_procs(cgroup)) < 0)
+            goto err;
+    }
+
+    /* O_CLOEXEC keeps the read ends out of every other instance. The status
+     * pipe is closed by a successful execl, so the parent reads EOF, or the
+     * errno of a failed one. */
+    if (pipe2(stdout_link, O_CLOEXEC) != 0 || pipe2(stderr_link, O_CLOEXEC) != 0 ||
+        pipe2(status_link, O_CLOEXEC) != 0)
         goto err;
 
-    (*cur)->pid = fork();
-    if ((*cur)->pid == 0)
+    pid_t pid = fork();
+    if (pid == 0)
     {
         dup2(stdout_link[1], STDOUT_FILENO);
-        close(stdout_link[0]);
-        close(stdout_link[1]);
         dup2(stderr_link[1], STDERR_FILENO);
-        close(stderr_link[0]);
-        close(stderr_link[1]);
+
+        /* The signal mask survives execl, and appstart blocks the signals it
+         * reads through a signalfd, see al_watch_exits. */
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
+        /* A group of its own, so closing reaches all its descendants. */
+        setpgid(0, 0);
+
+        if (options != NULL && al_apply_options(options, procs_fd) != EXIT_SUCCESS)
+        {
+            error = errno;
+            (void)!write(status_link[1], &error, sizeof(error));
+            _exit(127);
+        }
 
         /* execl will destroy the current process context. So it will only
-         * return if something goes wrong. */
+         * return if something goes wrong, and then this copy of the parent
+         * must not run any further. */
         execl(app->path, app->name, NULL);
+        error = errno;
+        /* Nothing is left to report a failed write to. */
+        (void)!write(status_link[1], &error, sizeof(error));
+        _exit(127);
+    }
+    else if (pid < 0)
+    {
         goto err;
     }
-    else if ((*cur)->pid > 0)
+
+    int64_t fork_ns = al_elapsed_ns(&launched);
+    if (procs_fd > -1)
     {
-        close(stdout_link[1]);
-        (*cur)->stdout = stdout_link[0];
-        close(stderr_link[1]);
-        (*cur)->stderr = stderr_link[0];
+        close(procs_fd);
+        procs_fd = -1;
+    }
+    close(stdout_link[1]);
+    close(stderr_link[1]);
+    close(status_link[1]);
+    stdout_link[1] = stderr_link[1] = status_link[1] = -1;
 
-        return *cur;
+    ssize_t nread;
+    while ((nread = read(status_link[0], &error, sizeof(error))) < 0 && errno == EINTR)
+        ;
+    int64_t exec_ns = al_elapsed_ns(&launched) - fork_ns;
+    close(status_link[0]);
+    status_link[0] = -1;
+    if (nread == sizeof(error))
+    {
+        waitpid(pid, NULL, 0);
+        goto err;
     }
-    else
+
+    struct al_instance *instance =
+        al_add_instance(app, pid, stdout_link[0], stderr_link[0], &launched, fork_ns, exec_ns);
+    if (instance == NULL)
     {
+        al_abandon(pid, stdout_link[0], stderr_link[0]);
+        stdout_link[0] = stderr_link[0] = -1;
         goto err;
     }
+    /* Without memory for the path, the cgroup is merely left behind. */
+    if (cgroup[0] != '\0')
+        instance->cgroup = strdup(cgroup);
+    return instance;
 
 err:
-    if (*cur != NULL)
+    error = error != 0 ? error : errno;
+    if (procs_fd > -1)
+        close(procs_fd);
+    if (cgroup[0] != '\0')
+        cg_remove(cgroup, CGROUP_FREE_WAIT_MS);
+    for (int i = 0; i < 2; i++)
     {
-        free(*cur);
-        *cur = NULL;
+        if (stdout_link[i] > -1)
+            close(stdout_link[i]);
+        if (stderr_link[i] > -1)
+            close(stderr_link[i]);
+        if (status_link[i] > -1)
+            close(status_link[i]);
     }
-
-    if (stdout_link[0] > -1)
-        close(stdout_link[0]);
-    if (stdout_link[1] > -1)
-        close(stdout_link[1]);
-    if (stderr_link[0] > -1)
-        close(stderr_link[0]);
-    if (stderr_link[1] > -1)
-        close(stderr_link[1]);
+    errno = error;
     return NULL;
 }
 
-void al_close_instance(struct al_instance *instance)
+int al_create_instances(struct al_item *app, int count)
+{
+    int created = 0;
+    if (!zy_active())
+    {
+        for (int i = 0; i < count; i++)
+            if (al_create_instance(app) != NULL)
+                created++;
+        return created;
+    }
+
+    /* Keep the helper busy while the replies are processed. */
+    struct timespec launched[ZY_MAX_IN_FLIGHT];
+    int sent = 0;
+    int received = 0;
+    while (received < count)
+    {
+        while (sent < count && sent - received < ZY_MAX_IN_FLIGHT)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &launched[sent % ZY_MAX_IN_FLIGHT]);
+            if (zy_request(app->path, app->name) != EXIT_SUCCESS)
+                break;
+            sent++;
+        }
+        if (sent == received)
+            break;
+        if (al_receive_instance(app, &launched[received % ZY_MAX_IN_FLIGHT]) != NULL)
+            created++;
+        received++;
+    }
+    return created;
+}
+
+/* Unlink an instance from its app. Running ones get SIGTERM and are moved to
+ * the closing list, exited ones are freed. Returns whether the instance still
+ * has to be waited for because no exit handler will reap it. */
+static int al_detach_instance(struct al_instance *instance)
 {
-    kill(instance->pid, SIGTERM);
-    waitpid(instance->pid, NULL, 0);
+    int detach = 0;
+    /* The group id of an exited instance may belong to any process by now.
+     * Its cgroup, if any, still holds its descendants; freeing it kills
+     * them, see al_remove_cgroup. */
+    if (!instance->exited)
+    {
+        al_signal(instance, SIGTERM);
+        detach = 1;
+    }
 
     if (instance->next != NULL)
     {
@@ -146,64 +1264,102 @@ void al_close_instance(struct al_instance *instance)
     instance->next = NULL;
     instance->previous = NULL;
 
-    if (instance->stdout > -1)
+    /* Freed once it is reaped. */
+    if (detach)
     {
-        close(instance->stdout);
-        instance->stdout = -1;
-    }
-    if (instance->stderr > -1)
-    {
-        close(instance->stderr);
-        instance->stderr = -1;
+        instance->closing = 1;
+        instance->app = NULL;
+        instance->next = closing;
+        if (closing != NULL)
+            closing->previous = instance;
+        closing = instance;
+        return !instance->watched;
     }
+    al_free_instance(instance);
+    return 0;
+}
 
-    free(instance);
+void al_close_instance(struct al_instance *instance)
+{
+    if (al_detach_instance(instance))
+        al_wait_closing();
 }
 
 void al_close_instances(struct al_item *app)
 {
     struct al_instance *cur = app->instances;
     struct al_instance *next = NULL;
+    int wait = 0;
+
+    /* Signal all of them first, so they exit in parallel. */
     while (cur != NULL)
     {
         next = cur->next;
-        al_close_instance(cur);
+        wait |= al_detach_instance(cur);
         cur = next;
     }
+    if (wait)
+        al_wait_closing();
 }
 
 int al_search(const char *dir_path, struct al_item **apps)
 {
-    int ret = 0;
     DIR *d;
     struct dirent *dir;
+    struct al_catalog *catalog;
+
+    *apps = NULL;
     d = opendir(dir_path);
-    if (d)
+    if (!d)
+        return -1;
+
+    catalog = malloc(sizeof(struct al_catalog));
+    if (catalog == NULL)
+    {
+        closedir(d);
+        return -1;
+    }
+    al_catalog_init(catalog);
+
+    while ((dir = readdir(d)) != NULL)
     {
-        struct al_item **current = apps;
-        struct al_item *previous = NULL;
-        while ((dir = readdir(d)) != NULL)
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
         {
-            if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
-            {
-                continue;
-            }
-            al_create(current, dir_path, dir->d_name, NULL, previous);
-            previous = *current;
-            current = &(*current)->next;
-            ret++;
+            continue;
         }
-        closedir(d);
+        if (al_catalog_add(catalog, dir_path, dir->d_name) != EXIT_SUCCESS)
+            break;
     }
-    else
+    closedir(d);
+
+    if (al_catalog_finish(catalog) != EXIT_SUCCESS)
     {
-        ret = EXIT_FAILURE;
+        al_catalog_dispose(catalog);
+        free(catalog);
+        return -1;
     }
-    return ret;
+    if (catalog->count == 0)
+    {
+        al_catalog_dispose(catalog);
+        free(catalog);
+        return 0;
+    }
+    *apps = catalog->items;
+    return catalog->count;
 }
 
 struct al_item *al_skip_pages(struct al_item *apps, int page, int itemsPerPage)
 {
+    if (apps != NULL && apps->catalog != NULL)
+    {
+        struct al_catalog *catalog = apps->catalog;
+        if (page == 0)
+            return apps;
+        if (itemsPerPage < 0)
+            return &catalog->items[page > 0 ? catalog->count - 1 : 0];
+        return al_catalog_at(catalog, apps->index + page * itemsPerPage);
+    }
+
     struct al_item *cur = apps;
     int _page = abs(page);
     struct al_item *advance = NULL;
@@ -251,6 +1407,9 @@ struct al_item *al_display_page(struct al_item *apps, int itemsPerPage, int *dis
 
 struct al_item *al_at(struct al_item *apps, int index)
 {
+    if (apps != NULL && apps->catalog != NULL)
+        return al_catalog_at(apps->catalog, apps->index + index);
+
     struct al_item *cur = apps;
     int _index = abs(index);
     for (int i = 0; i < _index && cur != NULL; i++)
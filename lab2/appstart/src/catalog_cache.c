@@ -0,0 +1,437 @@
+#define _GNU_SOURCE
+#include "catalog_cache.h"
+#include "event_loop.h"
+#include "path_scan.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <unistd.h>
+
+#define CC_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_CLOSE_WRITE | \
+                       IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/* Events after which single names cannot be trusted anymore. */
+#define CC_RESCAN_MASK (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct cc_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t dir_count;
+    uint32_t item_count;
+    uint32_t dirs_length;
+    uint64_t pool_length;
+};
+
+static int cc_split(struct cc_cache *cache)
+{
+    int capacity = 1;
+    for (const char *c = cache->dirs; *c != '\0'; c++)
+        if (*c == ':')
+            capacity++;
+
+    cache->dir_list = calloc(capacity, sizeof(char *));
+    cache->stamps = calloc(capacity, sizeof(struct cc_stamp));
+    if (cache->dir_list == NULL || cache->stamps == NULL)
+        return EXIT_FAILURE;
+
+    const char *start = cache->dirs;
+    while (1)
+    {
+        const char *end = strchrnul(start, ':');
+        if (end > start)
+        {
+            cache->dir_list[cache->dir_count] = strndup(start, end - start);
+            if (cache->dir_list[cache->dir_count] == NULL)
+                return EXIT_FAILURE;
+            cache->dir_count++;
+        }
+        if (*end == '\0')
+            break;
+        start = end + 1;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void cc_stamp_dirs(struct cc_cache *cache)
+{
+    for (int i = 0; i < cache->dir_count; i++)
+    {
+        struct stat st;
+        memset(&cache->stamps[i], 0, sizeof(struct cc_stamp));
+        if (stat(cache->dir_list[i], &st) != 0)
+            continue;
+        cache->stamps[i].dev = st.st_dev;
+        cache->stamps[i].ino = st.st_ino;
+        cache->stamps[i].mtime_sec = st.st_mtim.tv_sec;
+        cache->stamps[i].mtime_nsec = st.st_mtim.tv_nsec;
+    }
+}
+
+static int cc_load(struct cc_cache *cache, struct al_catalog *catalog)
+{
+    struct stat st;
+    int fd = open(cache->file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return EXIT_FAILURE;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct cc_header))
+    {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    size_t size = st.st_size;
+    char *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return EXIT_FAILURE;
+
+    const struct cc_header *header = (const struct cc_header *)mapping;
+    size_t dirs_length = strlen(cache->dirs) + 1;
+    if (memcmp(header->magic, CC_MAGIC, sizeof(header->magic)) != 0 || header->version != CC_VERSION ||
+        header->dir_count != (uint32_t)cache->dir_count || header->dirs_length != dirs_length ||
+        header->item_count > size / sizeof(struct al_catalog_entry) || header->pool_length > size)
+        goto err;
+
+    size_t stamps_offset = sizeof(struct cc_header);
+    size_t entries_offset = stamps_offset + header->dir_count * sizeof(struct cc_stamp);
+    size_t dirs_offset = entries_offset + header->item_count * sizeof(struct al_catalog_entry);
+    size_t pool_offset = dirs_offset + header->dirs_length;
+    if (pool_offset + header->pool_length != size)
+        goto err;
+
+    /* Stale if the directory list or any directory changed since the write. */
+    if (memcmp(mapping + dirs_offset, cache->dirs, dirs_length) != 0 ||
+        memcmp(mapping + stamps_offset, cache->stamps, header->dir_count * sizeof(struct cc_stamp)) != 0)
+        goto err;
+
+    const struct al_catalog_entry *entries = (const struct al_catalog_entry *)(mapping + entries_offset);
+    const char *pool = mapping + pool_offset;
+    if (header->item_count > 0 && (header->pool_length == 0 || pool[header->pool_length - 1] != '\0'))
+        goto err;
+    for (uint32_t i = 0; i < header->item_count; i++)
+        if (entries[i].path > entries[i].name || entries[i].name >= header->pool_length)
+            goto err;
+
+    if (al_catalog_map(catalog, pool, header->pool_length, entries, header->item_count, mapping, size) != EXIT_SUCCESS)
+        goto err;
+    return EXIT_SUCCESS;
+
+err:
+    munmap(mapping, size);
+    return EXIT_FAILURE;
+}
+
+int cc_store(const struct cc_cache *cache)
+{
+    const struct al_catalog *catalog = cache->catalog;
+    if (cache->file == NULL || catalog == NULL || catalog->pool_length > UINT32_MAX)
+        return EXIT_FAILURE;
+
+    struct cc_header header = {
+        .version = CC_VERSION,
+        .dir_count = cache->dir_count,
+        .item_count = catalog->count,
+        .dirs_length = strlen(cache->dirs) + 1,
+        .pool_length = catalog->pool_length,
+    };
+    memcpy(header.magic, CC_MAGIC, sizeof(header.magic));
+
+    struct al_catalog_entry *entries = malloc((catalog->count > 0 ? catalog->count : 1) * sizeof(struct al_catalog_entry));
+    char *tmp = malloc(strlen(cache->file) + sizeof(".XXXXXX"));
+    if (entries == NULL || tmp == NULL)
+    {
+        free(entries);
+        free(tmp);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < catalog->count; i++)
+    {
+        entries[i].path = catalog->items[i].path - catalog->pool;
+        entries[i].name = catalog->items[i].name - catalog->pool;
+    }
+
+    struct iovec iov[] = {
+        {.iov_base = &header, .iov_len = sizeof(header)},
+        {.iov_base = cache->stamps, .iov_len = cache->dir_count * sizeof(struct cc_stamp)},
+        {.iov_base = entries, .iov_len = catalog->count * sizeof(struct al_catalog_entry)},
+        {.iov_base = cache->dirs, .iov_len = header.dirs_length},
+        {.iov_base = catalog->pool, .iov_len = catalog->pool_length},
+    };
+    size_t total = 0;
+    for (size_t i = 0; i < sizeof(iov) / sizeof(iov[0]); i++)
+        total += iov[i].iov_len;
+
+    /* Write a sibling and rename it over the cache, so a running appstart keeps
+     * its mapping of the old file and readers never see a partial one. */
+    int ret = EXIT_FAILURE;
+    sprintf(tmp, "%s.XXXXXX", cache->file);
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd > -1)
+    {
+        ssize_t written = writev(fd, iov, sizeof(iov) / sizeof(iov[0]));
+        if (close(fd) == 0 && written == (ssize_t)total && rename(tmp, cache->file) == 0)
+            ret = EXIT_SUCCESS;
+        else
+            unlink(tmp);
+    }
+
+    free(entries);
+    free(tmp);
+    return ret;
+}
+
+int cc_open(struct cc_cache *cache, const char *file, const char *dirs, int threads)
+{
+    memset(cache, 0, sizeof(struct cc_cache));
+    cache->inotify_fd = -1;
+    cache->threads = threads;
+
+    cache->dirs = strdup(dirs);
+    if (cache->dirs == NULL || cc_split(cache) != EXIT_SUCCESS)
+        goto err;
+    if (file != NULL && (cache->file = strdup(file)) == NULL)
+        goto err;
+
+    struct al_catalog *catalog = malloc(sizeof(struct al_catalog));
+    if (catalog == NULL)
+        goto err;
+    al_catalog_init(catalog);
+
+    /* Stamp first, so changes during the scan make the cache stale. */
+    cc_stamp_dirs(cache);
+    if (cache->file != NULL && cc_load(cache, catalog) == EXIT_SUCCESS)
+    {
+        cache->catalog = catalog;
+        return catalog->count;
+    }
+
+    if (ps_scan(cache->dirs, threads, catalog) < 0)
+    {
+        al_catalog_dispose(catalog);
+        free(catalog);
+        goto err;
+    }
+    cache->catalog = catalog;
+
+    /* The cache only speeds up the next start, so failing to write it is fine. */
+    cc_store(cache);
+    return catalog->count;
+
+err:
+    cc_close(cache);
+    return -1;
+}
+
+static void cc_add_watches(struct cc_cache *cache)
+{
+    for (int i = 0; i < cache->dir_count; i++)
+        inotify_add_watch(cache->inotify_fd, cache->dir_list[i], CC_WATCH_MASK);
+}
+
+/* Index of the first directory providing an executable of the given name. */
+static int cc_resolve(const struct cc_cache *cache, const char *name)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    for (int i = 0; i < cache->dir_count; i++)
+    {
+        if (snprintf(path, sizeof(path), "%s/%s", cache->dir_list[i], name) >= (int)sizeof(path))
+            continue;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && faccessat(AT_FDCWD, path, X_OK, AT_EACCESS) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int cc_compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static int cc_rebuild(struct cc_cache *cache, struct al_catalog *catalog, const char **names, int count, int rescan,
+                      int *kept)
+{
+    struct al_catalog *old = cache->catalog;
+
+    if (rescan)
+    {
+        struct al_catalog scan;
+        al_catalog_init(&scan);
+        int ret = ps_scan(cache->dirs, cache->threads, &scan);
+        for (int i = 0; ret >= 0 && i < scan.count; i++)
+            if (al_catalog_add_item(catalog, &scan.items[i]) != EXIT_SUCCESS)
+                ret = -1;
+        al_catalog_dispose(&scan);
+        if (ret < 0)
+            return EXIT_FAILURE;
+
+        /* Running instances keep their item even if the binary is gone. */
+        for (int i = 0; i < old->count; i++)
+        {
+            if (old->items[i].instances == NULL)
+                continue;
+            if (al_catalog_add_item(catalog, &old->items[i]) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+            (*kept)++;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    for (int i = 0; i < old->count; i++)
+    {
+        const char *name = old->items[i].name;
+        if (bsearch(&name, names, count, sizeof(char *), cc_compare_names) != NULL)
+            continue;
+        if (al_catalog_add_item(catalog, &old->items[i]) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        int dir = cc_resolve(cache, names[i]);
+        if (dir > -1)
+        {
+            if (al_catalog_add(catalog, cache->dir_list[dir], names[i]) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+            continue;
+        }
+        int index = al_catalog_find(old, names[i]);
+        if (index < 0 || old->items[index].instances == NULL)
+            continue;
+        if (al_catalog_add_item(catalog, &old->items[index]) != EXIT_SUCCESS)
+            return EXIT_FAILURE;
+        (*kept)++;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void cc_update(struct cc_cache *cache, const char **names, int count, int rescan)
+{
+    struct al_catalog *old = cache->catalog;
+    struct al_catalog *catalog = malloc(sizeof(struct al_catalog));
+    if (catalog == NULL)
+        return;
+    al_catalog_init(catalog);
+
+    /* Events arriving after the stamp are handled in the next round. */
+    cc_stamp_dirs(cache);
+    if (rescan)
+        cc_add_watches(cache);
+
+    int kept = 0;
+    qsort(names, count, sizeof(char *), cc_compare_names);
+    if (cc_rebuild(cache, catalog, names, count, rescan, &kept) != EXIT_SUCCESS ||
+        al_catalog_finish(catalog) != EXIT_SUCCESS)
+    {
+        al_catalog_dispose(catalog);
+        free(catalog);
+        return;
+    }
+
+    /* Items kept alive for their instances must not outlive this run, so write
+     * stamps that never match and let the next start rescan. */
+    if (kept > 0)
+        for (int i = 0; i < cache->dir_count; i++)
+            cache->stamps[i].mtime_nsec = -1;
+
+    al_catalog_migrate(old, catalog);
+    cache->catalog = catalog;
+    if (cache->callback != NULL)
+        cache->callback(old, catalog, cache->data);
+    al_catalog_dispose(old);
+    free(old);
+
+    cc_store(cache);
+}
+
+static void cc_on_inotify(struct el_handler *handler, int fd, uint32_t events, void *data)
+{
+    static char buffer[CC_EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    static const char *names[CC_EVENT_BUFFER_SIZE / sizeof(struct inotify_event)];
+    struct cc_cache *cache = data;
+
+    /* One read per wake-up, the level-triggered event loop brings us back. */
+    ssize_t length = read(fd, buffer, sizeof(buffer));
+    if (length <= 0)
+        return;
+
+    int count = 0;
+    int rescan = 0;
+    for (ssize_t pos = 0; pos < length;)
+    {
+        const struct inotify_event *event = (const struct inotify_event *)(buffer + pos);
+        pos += sizeof(struct inotify_event) + event->len;
+
+        if (event->mask & CC_RESCAN_MASK)
+            rescan = 1;
+        else if (event->len > 0)
+            names[count++] = event->name;
+    }
+    if (count > 0 || rescan)
+        cc_update(cache, names, count, rescan);
+}
+
+int cc_watch(struct cc_cache *cache, cc_callback callback, void *data)
+{
+    if (cache->catalog == NULL)
+        return EXIT_FAILURE;
+
+    cache->callback = callback;
+    cache->data = data;
+    cache->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cache->inotify_fd < 0)
+        return EXIT_FAILURE;
+    cc_add_watches(cache);
+
+    cache->handler = el_add(cache->inotify_fd, EPOLLIN, cc_on_inotify, cache);
+    if (cache->handler == NULL)
+    {
+        close(cache->inotify_fd);
+        cache->inotify_fd = -1;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void cc_close(struct cc_cache *cache)
+{
+    if (cache->handler != NULL)
+    {
+        el_remove(cache->handler);
+        cache->handler = NULL;
+    }
+    if (cache->inotify_fd > -1)
+    {
+        close(cache->inotify_fd);
+        cache->inotify_fd = -1;
+    }
+    if (cache->catalog != NULL)
+    {
+        al_catalog_dispose(cache->catalog);
+        free(cache->catalog);
+        cache->catalog = NULL;
+    }
+    if (cache->dir_list != NULL)
+        for (int i = 0; i < cache->dir_count; i++)
+            free(cache->dir_list[i]);
+    free(cache->dir_list);
+    free(cache->stamps);
+    free(cache->dirs);
+    free(cache->file);
+    cache->dir_list = NULL;
+    cache->stamps = NULL;
+    cache->dirs = NULL;
+    cache->file = NULL;
+    cache->dir_count = 0;
+}
@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include "cgroup.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mntent.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sys/stat.h>
+
+#include <unistd.h>
+
+#define CG_PROCS_BUFFER_SIZE (4096)
+
+/* Cgroup appstart was started in, found on first use. */
+static char base[PATH_MAX];
+static unsigned long created = 0;
+
+static int cg_write(const char *dir, const char *file, const char *value)
+{
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, file) >= (int)sizeof(path))
+    {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return EXIT_FAILURE;
+    size_t length = strlen(value);
+    ssize_t written = write(fd, value, length);
+    int error = errno;
+    close(fd);
+    errno = error;
+    return written == (ssize_t)length ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int cg_find_base(void)
+{
+    if (base[0] != '\0')
+        return EXIT_SUCCESS;
+
+    char mount[PATH_MAX] = "";
+    FILE *mounts = setmntent("/proc/self/mounts", "r");
+    if (mounts == NULL)
+        return EXIT_FAILURE;
+    struct mntent *entry;
+    while ((entry = getmntent(mounts)) != NULL)
+    {
+        if (strcmp(entry->mnt_type, "cgroup2") == 0)
+        {
+            snprintf(mount, sizeof(mount), "%s", entry->mnt_dir);
+            break;
+        }
+    }
+    endmntent(mounts);
+
+    /* The unified hierarchy is the "0::" line. */
+    char own[PATH_MAX] = "";
+    char line[PATH_MAX];
+    FILE *cgroups = fopen("/proc/self/cgroup", "re");
+    if (cgroups == NULL)
+        return EXIT_FAILURE;
+    while (fgets(line, sizeof(line), cgroups) != NULL)
+    {
+        if (strncmp(line, "0::", 3) == 0)
+        {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(own, sizeof(own), "%s", line + 3);
+            break;
+        }
+    }
+    fclose(cgroups);
+
+    if (mount[0] == '\0' || own[0] == '\0')
+    {
+        errno = ENOTSUP;
+        return EXIT_FAILURE;
+    }
+    if (snprintf(base, sizeof(base), "%s%s", mount, strcmp(own, "/") == 0 ? "" : own) >= (int)sizeof(base))
+    {
+        base[0] = '\0';
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Move appstart and its direct children, e.g. the launcher helper and
+ * instances without a cgroup of their own, into the CG_SELF_NAME leaf. */
+static int cg_move_self(void)
+{
+    char leaf[PATH_MAX];
+    char procs[CG_PROCS_BUFFER_SIZE];
+    if (snprintf(leaf, sizeof(leaf), "%s/" CG_SELF_NAME, base) >= (int)sizeof(leaf) ||
+        snprintf(procs, sizeof(procs), "%s/cgroup.procs", base) >= (int)sizeof(procs))
+    {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    if (mkdir(leaf, 0755) != 0 && errno != EEXIST)
+        return EXIT_FAILURE;
+
+    FILE *list = fopen(procs, "re");
+    if (list == NULL)
+        return EXIT_FAILURE;
+    int pid;
+    pid_t self = getpid();
+    while (fscanf(list, "%d", &pid) == 1)
+    {
+        char stat[64];
+        int parent = 0;
+        snprintf(stat, sizeof(stat), "/proc/%d/stat", pid);
+        FILE *file = fopen(stat, "re");
+        if (file != NULL)
+        {
+            /* The parent pid follows the last ')' and the state. */
+            char buffer[512];
+            size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+            buffer[length] = '\0';
+            char *end = strrchr(buffer, ')');
+            if (end != NULL)
+                sscanf(end + 1, " %*c %d", &parent);
+            fclose(file);
+        }
+        if (pid == self || parent == self)
+        {
+            snprintf(procs, sizeof(procs), "%d", pid);
+            cg_write(leaf, "cgroup.procs", procs);
+        }
+    }
+    fclose(list);
+    return EXIT_SUCCESS;
+}
+
+static int cg_enable(const char *controller)
+{
+    char value[32];
+    snprintf(value, sizeof(value), "+%s", controller);
+    if (cg_write(base, "cgroup.subtree_control", value) == EXIT_SUCCESS)
+        return EXIT_SUCCESS;
+    /* Processes of our own block controllers, see CG_SELF_NAME. */
+    if (errno != EBUSY || cg_move_self() != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    return cg_write(base, "cgroup.subtree_control", value);
+}
+
+int cg_create(const char *cpu_max, uint64_t memory_max, char *path, size_t length)
+{
+    if (cg_find_base() != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    if ((cpu_max != NULL && *cpu_max != '\0' && cg_enable("cpu") != EXIT_SUCCESS) ||
+        (memory_max > 0 && cg_enable("memory") != EXIT_SUCCESS))
+        return EXIT_FAILURE;
+
+    if (snprintf(path, length, "%s/instance-%d-%lu", base, (int)getpid(), created++) >= (int)length)
+    {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    if (mkdir(path, 0755) != 0)
+        return EXIT_FAILURE;
+
+    char memory[32];
+    snprintf(memory, sizeof(memory), "%llu", (unsigned long long)memory_max);
+    if ((cpu_max != NULL && *cpu_max != '\0' && cg_write(path, "cpu.max", cpu_max) != EXIT_SUCCESS) ||
+        (memory_max > 0 && cg_write(path, "memory.max", memory) != EXIT_SUCCESS))
+    {
+        int error = errno;
+        rmdir(path);
+        errno = error;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int cg_open_procs(const char *path)
+{
+    char procs[PATH_MAX];
+    if (snprintf(procs, sizeof(procs), "%s/cgroup.procs", path) >= (int)sizeof(procs))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return open(procs, O_WRONLY | O_CLOEXEC);
+}
+
+int cg_kill(const char *path)
+{
+    return cg_write(path, "cgroup.kill", "1");
+}
+
+static long long cg_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/* Wait for cgroup.events to report "populated 0". The file signals POLLPRI
+ * on every change, so there is no need to poll it in a loop. */
+static int cg_wait_empty(const char *path, int timeout)
+{
+    char events[PATH_MAX];
+    if (snprintf(events, sizeof(events), "%s/cgroup.events", path) >= (int)sizeof(events))
+    {
+        errno = ENAMETOOLONG;
+        return EXIT_FAILURE;
+    }
+    int fd = open(events, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return EXIT_FAILURE;
+
+    long long deadline = cg_now_ms() + timeout;
+    int result = EXIT_FAILURE;
+    while (1)
+    {
+        char buffer[256];
+        ssize_t length = pread(fd, buffer, sizeof(buffer) - 1, 0);
+        if (length < 0)
+            break;
+        buffer[length] = '\0';
+        char *populated = strstr(buffer, "populated ");
+        if (populated != NULL && populated[strlen("populated ")] == '0')
+        {
+            result = EXIT_SUCCESS;
+            break;
+        }
+
+        long long left = deadline - cg_now_ms();
+        if (left <= 0)
+        {
+            errno = EBUSY;
+            break;
+        }
+        struct pollfd changed = {.fd = fd, .events = POLLPRI};
+        if (poll(&changed, 1, (int)left) < 0 && errno != EINTR)
+            break;
+    }
+    int error = errno;
+    close(fd);
+    errno = error;
+    return result;
+}
+
+int cg_remove(const char *path, int timeout)
+{
+    if (rmdir(path) == 0 || errno == ENOENT)
+        return EXIT_SUCCESS;
+    if (errno != EBUSY)
+        return EXIT_FAILURE;
+
+    /* Descendants that left the instance's process group are still in it. */
+    if (cg_kill(path) != EXIT_SUCCESS || cg_wait_empty(path, timeout) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    return rmdir(path) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
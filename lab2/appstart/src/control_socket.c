@@ -0,0 +1,479 @@
+#define _GNU_SOURCE
+#include "control_socket.h"
+#include "event_loop.h"
+#include "fuzzy_filter.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <unistd.h>
+
+/* Upper bound of reads per wake-up, like the instance output drain. */
+#define CS_READS_PER_EVENT (16)
+
+/* Stop reading requests from a client that does not read its responses. */
+#define CS_OUTPUT_HIGH_WATER (1024 * 1024)
+
+struct cs_client
+{
+    int fd;
+    struct el_handler *handler;
+
+    char in[CS_LINE_MAX];
+    size_t in_length;
+    int discarding;
+    int eof;
+
+    char *out;
+    size_t out_length;
+    size_t out_capacity;
+    size_t out_sent;
+    int failed;
+
+    struct cs_client *next;
+    struct cs_client *previous;
+};
+
+static int listen_fd = -1;
+static struct el_handler *listen_handler = NULL;
+static char socket_path[sizeof(((struct sockaddr_un *)NULL)->sun_path)];
+static struct cc_cache *served = NULL;
+static struct cs_client *clients = NULL;
+
+/* Shared by all clients, so repeated searches reuse the name masks. */
+static struct ff_filter search;
+
+static void cs_printf(struct cs_client *client, const char *fmt, ...)
+{
+    va_list args;
+    while (!client->failed)
+    {
+        size_t room = client->out_capacity - client->out_length;
+        va_start(args, fmt);
+        int length = vsnprintf(client->out != NULL ? client->out + client->out_length : NULL, room, fmt, args);
+        va_end(args);
+        if (length < 0)
+        {
+            client->failed = 1;
+            return;
+        }
+        if ((size_t)length < room)
+        {
+            client->out_length += length;
+            return;
+        }
+
+        size_t capacity = client->out_capacity > 0 ? client->out_capacity * 2 : CS_LINE_MAX;
+        while (capacity - client->out_length <= (size_t)length)
+            capacity *= 2;
+        char *out = realloc(client->out, capacity);
+        if (out == NULL)
+        {
+            client->failed = 1;
+            return;
+        }
+        client->out = out;
+        client->out_capacity = capacity;
+    }
+}
+
+static int cs_number(const char *token, int *number)
+{
+    char *end;
+    if (token == NULL)
+        return EXIT_FAILURE;
+    long value = strtol(token, &end, 10);
+    if (end == token || *end != '\0' || value < 0)
+        return EXIT_FAILURE;
+    *number = (int)value;
+    return EXIT_SUCCESS;
+}
+
+static void cs_list(struct cs_client *client, char **state)
+{
+    struct al_catalog *catalog = served->catalog;
+    int total = catalog != NULL ? catalog->count : 0;
+    int offset = 0;
+    int count = total;
+    char *token = strtok_r(NULL, " \t", state);
+    if (token != NULL && cs_number(token, &offset) != EXIT_SUCCESS)
+    {
+        cs_printf(client, "err invalid offset\n");
+        return;
+    }
+    if ((token = strtok_r(NULL, " \t", state)) != NULL && cs_number(token, &count) != EXIT_SUCCESS)
+    {
+        cs_printf(client, "err invalid count\n");
+        return;
+    }
+
+    if (offset > total)
+        offset = total;
+    if (count > total - offset)
+        count = total - offset;
+    cs_printf(client, "ok %d\n", count);
+    for (int i = offset; i < offset + count; i++)
+    {
+        struct al_item *item = &catalog->items[i];
+        int running = 0;
+        cs_printf(client, "%d %s %s ", i, item->name, item->path);
+        for (struct al_instance *instance = item->instances; instance != NULL; instance = instance->next)
+            if (!instance->exited)
+                cs_printf(client, running++ > 0 ? ",%d" : "%d", instance->pid);
+        cs_printf(client, running > 0 ? "\n" : "-\n");
+    }
+}
+
+static void cs_search(struct cs_client *client, char **state)
+{
+    char *query = strtok_r(NULL, " \t", state);
+    char *token = strtok_r(NULL, " \t", state);
+    int count = -1;
+    if (query == NULL)
+    {
+        cs_printf(client, "err missing query\n");
+        return;
+    }
+    if (token != NULL && cs_number(token, &count) != EXIT_SUCCESS)
+    {
+        cs_printf(client, "err invalid count\n");
+        return;
+    }
+
+    int matches = ff_update(&search, query);
+    if (matches < 0)
+    {
+        cs_printf(client, "err %s\n", strerror(ENOMEM));
+        return;
+    }
+    if (count < 0 || count > matches)
+        count = matches;
+    cs_printf(client, "ok %d\n", count);
+    for (int i = 0; i < count; i++)
+    {
+        struct al_item *item = ff_at(&search, i);
+        cs_printf(client, "%d %s\n", item->index, item->name);
+    }
+}
+
+static void cs_launch(struct cs_client *client, char **state)
+{
+    struct al_catalog *catalog = served->catalog;
+    char *name = strtok_r(NULL, " \t", state);
+    int index = name != NULL && catalog != NULL ? al_catalog_find(catalog, name) : -1;
+    if (index < 0)
+    {
+        cs_printf(client, "err no such app\n");
+        return;
+    }
+    struct al_item *app = &catalog->items[index];
+
+    struct al_launch_options options;
+    int with_options = 0;
+    int count = 1;
+    al_init_launch_options(&options);
+    for (char *token = strtok_r(NULL, " \t", state); token != NULL; token = strtok_r(NULL, " \t", state))
+    {
+        if (strchr(token, '=') == NULL)
+        {
+            if (cs_number(token, &count) != EXIT_SUCCESS || count == 0)
+            {
+                cs_printf(client, "err invalid count\n");
+                return;
+            }
+        }
+        else if (al_parse_launch_option(&options, token) != EXIT_SUCCESS)
+        {
+            cs_printf(client, "err invalid option %s\n", token);
+            return;
+        }
+        else
+        {
+            with_options = 1;
+        }
+    }
+
+    /* New instances are appended, so they follow the current last one. */
+    struct al_instance *last = app->instances;
+    while (last != NULL && last->next != NULL)
+        last = last->next;
+
+    int created = 0;
+    errno = 0;
+    if (with_options)
+    {
+        for (int i = 0; i < count; i++)
+            if (al_create_instance_with_options(app, &options) != NULL)
+                created++;
+    }
+    else
+    {
+        created = al_create_instances(app, count);
+    }
+    if (created == 0)
+    {
+        cs_printf(client, "err %s\n", strerror(errno != 0 ? errno : EAGAIN));
+        return;
+    }
+
+    cs_printf(client, "ok %d\n", created);
+    for (struct al_instance *instance = last != NULL ? last->next : app->instances; instance != NULL;
+         instance = instance->next)
+        cs_printf(client, "%d\n", instance->pid);
+}
+
+static void cs_close_instances(struct cs_client *client, char **state)
+{
+    char *target = strtok_r(NULL, " \t", state);
+    int pid;
+    if (target == NULL)
+    {
+        cs_printf(client, "err missing pid or name\n");
+        return;
+    }
+
+    if (cs_number(target, &pid) == EXIT_SUCCESS)
+    {
+        struct al_instance *instance = al_find_instance(pid);
+        if (instance == NULL || instance->app == NULL)
+        {
+            cs_printf(client, "err no such instance\n");
+            return;
+        }
+        al_close_instance(instance);
+        cs_printf(client, "ok 0\n");
+        return;
+    }
+
+    int index = served->catalog != NULL ? al_catalog_find(served->catalog, target) : -1;
+    if (index < 0)
+    {
+        cs_printf(client, "err no such app\n");
+        return;
+    }
+    al_close_instances(&served->catalog->items[index]);
+    cs_printf(client, "ok 0\n");
+}
+
+static void cs_stats(struct cs_client *client)
+{
+    struct al_catalog *catalog = served->catalog;
+    int total = catalog != NULL ? catalog->count : 0;
+    int running = 0;
+    int exited = 0;
+    int orphans = 0;
+    for (int i = 0; i < total; i++)
+    {
+        for (struct al_instance *instance = catalog->items[i].instances; instance != NULL; instance = instance->next)
+        {
+            if (instance->exited)
+                exited++;
+            else
+                running++;
+            orphans += instance->orphans;
+        }
+    }
+
+    const struct al_launch_timings *timings = al_get_launch_timings();
+    char fork[96];
+    char exec[96];
+    char output[96];
+    hg_format(&timings->fork, fork, sizeof(fork));
+    hg_format(&timings->exec, exec, sizeof(exec));
+    hg_format(&timings->first_output, output, sizeof(output));
+    cs_printf(client, "ok 7\napps %d\nrunning %d\nexited %d\norphans %d\nfork %s\nexec %s\noutput %s\n", total, running,
+              exited, orphans, fork, exec, output);
+}
+
+static void cs_execute(struct cs_client *client, char *line)
+{
+    char *state;
+    char *command = strtok_r(line, " \t", &state);
+    if (command == NULL)
+        return;
+    if (strcmp(command, "list") == 0)
+        cs_list(client, &state);
+    else if (strcmp(command, "search") == 0)
+        cs_search(client, &state);
+    else if (strcmp(command, "launch") == 0)
+        cs_launch(client, &state);
+    else if (strcmp(command, "close") == 0)
+        cs_close_instances(client, &state);
+    else if (strcmp(command, "stats") == 0)
+        cs_stats(client);
+    else
+        cs_printf(client, "err unknown command %s\n", command);
+}
+
+/* Execute every complete line and keep the rest for the next read. */
+static void cs_execute_lines(struct cs_client *client)
+{
+    char *start = client->in;
+    char *end = client->in + client->in_length;
+    char *newline;
+    while ((newline = memchr(start, '\n', end - start)) != NULL)
+    {
+        *newline = '\0';
+        if (newline > start && newline[-1] == '\r')
+            newline[-1] = '\0';
+        if (!client->discarding)
+            cs_execute(client, start);
+        client->discarding = 0;
+        start = newline + 1;
+    }
+
+    client->in_length = end - start;
+    memmove(client->in, start, client->in_length);
+    if (client->in_length == sizeof(client->in))
+    {
+        if (!client->discarding)
+            cs_printf(client, "err line too long\n");
+        client->discarding = 1;
+        client->in_length = 0;
+    }
+}
+
+static void cs_drop(struct cs_client *client)
+{
+    el_remove(client->handler);
+    close(client->fd);
+    if (client->next != NULL)
+        client->next->previous = client->previous;
+    if (client->previous != NULL)
+        client->previous->next = client->next;
+    else
+        clients = client->next;
+    free(client->out);
+    free(client);
+}
+
+static void cs_on_client(struct el_handler *handler, int fd, uint32_t events, void *data)
+{
+    struct cs_client *client = data;
+
+    for (int i = 0; i < CS_READS_PER_EVENT && (events & (EPOLLIN | EPOLLHUP)) && !client->eof; i++)
+    {
+        ssize_t length = read(fd, client->in + client->in_length, sizeof(client->in) - client->in_length);
+        if (length > 0)
+        {
+            client->in_length += length;
+            cs_execute_lines(client);
+            if (client->out_length - client->out_sent >= CS_OUTPUT_HIGH_WATER)
+                break;
+        }
+        else if (length == 0 || (errno != EAGAIN && errno != EINTR))
+        {
+            client->eof = 1;
+        }
+        else if (errno == EAGAIN)
+        {
+            break;
+        }
+    }
+
+    /* All responses of this round go out in one write if the socket takes
+     * them, the rest once it is writable again. */
+    while (client->out_sent < client->out_length && !client->failed)
+    {
+        ssize_t sent =
+            send(fd, client->out + client->out_sent, client->out_length - client->out_sent, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0 && errno != EAGAIN)
+            client->failed = 1;
+        if (sent <= 0)
+            break;
+        client->out_sent += sent;
+    }
+    if (client->out_sent == client->out_length)
+        client->out_sent = client->out_length = 0;
+
+    size_t pending = client->out_length - client->out_sent;
+    if (client->failed || (client->eof && pending == 0))
+    {
+        cs_drop(client);
+        return;
+    }
+    uint32_t watch = (pending < CS_OUTPUT_HIGH_WATER && !client->eof ? EPOLLIN : 0) | (pending > 0 ? EPOLLOUT : 0);
+    el_modify(handler, watch);
+}
+
+static void cs_on_accept(struct el_handler *handler, int fd, uint32_t events, void *data)
+{
+    int client_fd;
+    while ((client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) > -1)
+    {
+        struct cs_client *client = calloc(1, sizeof(struct cs_client));
+        if (client == NULL)
+        {
+            close(client_fd);
+            continue;
+        }
+        client->fd = client_fd;
+        client->handler = el_add(client_fd, EPOLLIN, cs_on_client, client);
+        if (client->handler == NULL)
+        {
+            close(client_fd);
+            free(client);
+            continue;
+        }
+        client->next = clients;
+        if (clients != NULL)
+            clients->previous = client;
+        clients = client;
+    }
+}
+
+int cs_open(const char *path, struct cc_cache *cache)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (listen_fd > -1 || strlen(path) >= sizeof(address.sun_path))
+        return EXIT_FAILURE;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        return EXIT_FAILURE;
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, CS_BACKLOG) != 0 ||
+        (listen_handler = el_add(listen_fd, EPOLLIN, cs_on_accept, NULL)) == NULL)
+    {
+        close(listen_fd);
+        listen_fd = -1;
+        return EXIT_FAILURE;
+    }
+    snprintf(socket_path, sizeof(socket_path), "%s", path);
+
+    served = cache;
+    ff_init(&search);
+    ff_set_catalog(&search, cache->catalog);
+    return EXIT_SUCCESS;
+}
+
+void cs_set_catalog(struct al_catalog *catalog)
+{
+    if (listen_fd > -1)
+        ff_set_catalog(&search, catalog);
+}
+
+void cs_close(void)
+{
+    if (listen_fd < 0)
+        return;
+    while (clients != NULL)
+        cs_drop(clients);
+    el_remove(listen_handler);
+    listen_handler = NULL;
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path);
+    ff_dispose(&search);
+    served = NULL;
+}
@@ -0,0 +1,110 @@
+#include "event_loop.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+#include <sys/epoll.h>
+
+#include <unistd.h>
+
+#define MAX_EVENTS (64)
+
+static int epoll_fd = -1;
+static struct el_handler *removed = NULL;
+
+static void free_removed(void)
+{
+    while (removed != NULL)
+    {
+        struct el_handler *next = removed->next_removed;
+        free(removed);
+        removed = next;
+    }
+}
+
+int el_init(void)
+{
+    if (epoll_fd > -1)
+        return EXIT_SUCCESS;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return epoll_fd > -1 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void el_dispose(void)
+{
+    if (epoll_fd > -1)
+    {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    free_removed();
+}
+
+int el_active(void)
+{
+    return epoll_fd > -1;
+}
+
+struct el_handler *el_add(int fd, uint32_t events, el_callback callback, void *data)
+{
+    if (epoll_fd < 0 || fd < 0)
+        return NULL;
+
+    struct el_handler *handler = malloc(sizeof(struct el_handler));
+    if (handler == NULL)
+        return NULL;
+    handler->fd = fd;
+    handler->callback = callback;
+    handler->data = data;
+    handler->next_removed = NULL;
+
+    struct epoll_event event = {.events = events, .data.ptr = handler};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        free(handler);
+        return NULL;
+    }
+    return handler;
+}
+
+int el_modify(struct el_handler *handler, uint32_t events)
+{
+    if (epoll_fd < 0 || handler == NULL || handler->fd < 0)
+        return EXIT_FAILURE;
+    struct epoll_event event = {.events = events, .data.ptr = handler};
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, handler->fd, &event) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void el_remove(struct el_handler *handler)
+{
+    if (handler == NULL)
+        return;
+    if (epoll_fd > -1 && handler->fd > -1)
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, handler->fd, NULL);
+
+    /* Events for this handler may still be pending in the current round. */
+    handler->fd = -1;
+    handler->next_removed = removed;
+    removed = handler;
+}
+
+int el_run_once(int timeout)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    if (epoll_fd < 0)
+        return -1;
+
+    int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+    if (count < 0)
+        return errno == EINTR ? 0 : -1;
+
+    for (int i = 0; i < count; i++)
+    {
+        struct el_handler *handler = events[i].data.ptr;
+        if (handler->fd > -1)
+            handler->callback(handler, handler->fd, events[i].events, handler->data);
+    }
+    free_removed();
+    return count;
+}
@@ -0,0 +1,246 @@
+#include "fuzzy_filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Scores start here, so gap penalties rarely clamp them to zero. */
+#define FF_BASE_SCORE (256)
+#define FF_BONUS_MATCH (4)
+#define FF_BONUS_CONSECUTIVE (8)
+#define FF_BONUS_BOUNDARY (6)
+#define FF_MAX_GAP_PENALTY (4)
+
+static uint64_t ff_class(unsigned char c)
+{
+    if (c >= 'a' && c <= 'z')
+        return 1ULL << (c - 'a');
+    if (c >= 'A' && c <= 'Z')
+        return 1ULL << (26 + c - 'A');
+    if (c >= '0' && c <= '9')
+        return 1ULL << (52 + c - '0');
+    /* Everything else shares two bits, split by the high bit. */
+    return 1ULL << (62 + (c >> 7));
+}
+
+static uint64_t ff_mask(const char *name)
+{
+    uint64_t mask = 0;
+    while (*name != '\0')
+        mask |= ff_class(*name++);
+    return mask;
+}
+
+static int ff_boundary(char c)
+{
+    return c == '-' || c == '_' || c == '.' || c == ' ' || c == '+';
+}
+
+/* Greedy leftmost subsequence match, -1 if query is not a subsequence. */
+static int ff_score(const struct ff_name *entry, const char *query, int length)
+{
+    const char *name = entry->name;
+    const char *at = name;
+    int score = FF_BASE_SCORE;
+    for (int i = 0; i < length; i++)
+    {
+        /* Names are short, an inline scan beats calling strchr. */
+        const char *found = at;
+        while (*found != query[i])
+            if (*found++ == '\0')
+                return -1;
+
+        int gap = found - at;
+        score += FF_BONUS_MATCH;
+        if (i > 0 && gap == 0)
+            score += FF_BONUS_CONSECUTIVE;
+        else if (found == name || ff_boundary(found[-1]))
+            score += FF_BONUS_BOUNDARY;
+        if (i > 0)
+            score -= gap < FF_MAX_GAP_PENALTY ? gap : FF_MAX_GAP_PENALTY;
+        at = found + 1;
+    }
+
+    /* Prefer shorter names among otherwise equal matches. */
+    size_t rest = entry->length - (at - name);
+    score -= rest < FF_MAX_GAP_PENALTY ? (int)rest : FF_MAX_GAP_PENALTY;
+    if (score < 0)
+        return 0;
+    return score < FF_MAX_SCORE ? score : FF_MAX_SCORE - 1;
+}
+
+static int ff_catalog_count(const struct ff_filter *filter)
+{
+    return filter->catalog != NULL && filter->catalog->items != NULL ? filter->catalog->count : 0;
+}
+
+static void ff_truncate(struct ff_filter *filter, int length)
+{
+    for (int i = length + 1; i <= filter->length; i++)
+    {
+        free(filter->levels[i].matches);
+        filter->levels[i].matches = NULL;
+        filter->levels[i].count = 0;
+    }
+    filter->length = length;
+    filter->query[length] = '\0';
+}
+
+/* First index in [start, end) whose name has a character above c (or at least
+ * c if inclusive) at position, given all of them share the characters before. */
+static int ff_bound(const struct al_item *items, int start, int end, int position, unsigned char c, int inclusive)
+{
+    while (start < end)
+    {
+        int mid = start + (end - start) / 2;
+        unsigned char at = items[mid].name[position];
+        if (at < c || (!inclusive && at == c))
+            start = mid + 1;
+        else
+            end = mid;
+    }
+    return start;
+}
+
+/* Match query[0, length) given the matches of query[0, length - 1). */
+static int ff_match(struct ff_filter *filter, int length)
+{
+    const struct al_item *items = filter->catalog != NULL ? filter->catalog->items : NULL;
+    const struct ff_level *previous = &filter->levels[length - 1];
+    struct ff_level *level = &filter->levels[length];
+    int total = ff_catalog_count(filter);
+    unsigned char c = filter->query[length - 1];
+
+    /* Names starting with the query narrow the previous prefix range. */
+    int start = length > 1 ? previous->prefix_start : 0;
+    int end = length > 1 ? previous->prefix_end : total;
+    start = ff_bound(items, start, end, length - 1, c, 1);
+    end = ff_bound(items, start, end, length - 1, c, 0);
+
+    /* Every other match of the query also matched the previous one. */
+    uint64_t query_mask = ff_mask(filter->query);
+    int candidates = length > 1 ? previous->count : total;
+    int found = 0;
+    for (int i = 0; i < candidates; i++)
+    {
+        int index = length > 1 ? previous->matches[i] : i;
+        if ((filter->names[index].mask & query_mask) != query_mask || (index >= start && index < end))
+            continue;
+        int score = ff_score(&filter->names[index], filter->query, length);
+        if (score < 0)
+            continue;
+        filter->sorted[found] = index;
+        filter->scores[found] = score;
+        found++;
+    }
+
+    int *matches = malloc((end - start + found > 0 ? end - start + found : 1) * sizeof(int));
+    if (matches == NULL)
+        return EXIT_FAILURE;
+    int count = 0;
+    for (int index = start; index < end; index++)
+        matches[count++] = index;
+
+    /* Scores are small, so a counting sort ranks the rest in linear time and
+     * keeps equal scores in their previous order. */
+    static int buckets[FF_MAX_SCORE + 1];
+    memset(buckets, 0, sizeof(buckets));
+    for (int i = 0; i < found; i++)
+        buckets[FF_MAX_SCORE - 1 - filter->scores[i] + 1]++;
+    buckets[0] = count;
+    for (int i = 1; i <= FF_MAX_SCORE; i++)
+        buckets[i] += buckets[i - 1];
+    for (int i = 0; i < found; i++)
+        matches[buckets[FF_MAX_SCORE - 1 - filter->scores[i]]++] = filter->sorted[i];
+
+    level->matches = matches;
+    level->count = count + found;
+    level->prefix_start = start;
+    level->prefix_end = end;
+    return EXIT_SUCCESS;
+}
+
+void ff_init(struct ff_filter *filter)
+{
+    memset(filter, 0, sizeof(struct ff_filter));
+}
+
+void ff_dispose(struct ff_filter *filter)
+{
+    ff_truncate(filter, 0);
+    free(filter->names);
+    free(filter->scores);
+    free(filter->sorted);
+    ff_init(filter);
+}
+
+int ff_set_catalog(struct ff_filter *filter, const struct al_catalog *catalog)
+{
+    char query[FF_MAX_QUERY];
+    memcpy(query, filter->query, sizeof(query));
+    ff_dispose(filter);
+
+    filter->catalog = catalog;
+    int total = ff_catalog_count(filter);
+    filter->names = malloc((total > 0 ? total : 1) * sizeof(struct ff_name));
+    filter->scores = malloc((total > 0 ? total : 1) * sizeof(int));
+    filter->sorted = malloc((total > 0 ? total : 1) * sizeof(int));
+    if (filter->names == NULL || filter->scores == NULL || filter->sorted == NULL)
+    {
+        ff_dispose(filter);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < total; i++)
+    {
+        filter->names[i].name = catalog->items[i].name;
+        filter->names[i].length = strlen(catalog->items[i].name);
+        filter->names[i].mask = ff_mask(catalog->items[i].name);
+    }
+
+    return ff_update(filter, query) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int ff_update(struct ff_filter *filter, const char *query)
+{
+    int length = 0;
+    while (length < FF_MAX_QUERY - 1 && query[length] != '\0')
+        length++;
+    int common = 0;
+    while (common < length && common < filter->length && filter->query[common] == query[common])
+        common++;
+    ff_truncate(filter, common);
+    if (length > 0 && filter->names == NULL)
+        return -1;
+
+    while (filter->length < length)
+    {
+        filter->query[filter->length] = query[filter->length];
+        filter->query[filter->length + 1] = '\0';
+        if (ff_match(filter, filter->length + 1) != EXIT_SUCCESS)
+        {
+            filter->query[filter->length] = '\0';
+            return -1;
+        }
+        filter->length++;
+    }
+    return ff_count(filter);
+}
+
+int ff_active(const struct ff_filter *filter)
+{
+    return filter->length > 0;
+}
+
+int ff_count(const struct ff_filter *filter)
+{
+    return filter->length > 0 ? filter->levels[filter->length].count : ff_catalog_count(filter);
+}
+
+struct al_item *ff_at(const struct ff_filter *filter, int index)
+{
+    if (filter->length == 0)
+        return filter->catalog != NULL ? al_catalog_at(filter->catalog, index) : NULL;
+    const struct ff_level *level = &filter->levels[filter->length];
+    if (index < 0 || index >= level->count)
+        return NULL;
+    return al_catalog_at(filter->catalog, level->matches[index]);
+}
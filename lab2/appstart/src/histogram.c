@@ -0,0 +1,97 @@
+#include "histogram.h"
+
+#include <string.h>
+
+#define BAR_WIDTH (40)
+
+static int hg_bucket(uint64_t ns)
+{
+    return ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+}
+
+static int hg_print_duration(char *buffer, size_t length, uint64_t ns)
+{
+    if (ns < 1000)
+        return snprintf(buffer, length, "%luns", (unsigned long)ns);
+    if (ns < 1000000)
+        return snprintf(buffer, length, "%.1fus", ns / 1e3);
+    if (ns < 1000000000)
+        return snprintf(buffer, length, "%.1fms", ns / 1e6);
+    return snprintf(buffer, length, "%.2fs", ns / 1e9);
+}
+
+void hg_init(struct hg *hg)
+{
+    memset(hg, 0, sizeof(struct hg));
+}
+
+void hg_add(struct hg *hg, uint64_t ns)
+{
+    int bucket = hg_bucket(ns);
+    if (bucket >= HG_BUCKETS)
+        bucket = HG_BUCKETS - 1;
+    hg->buckets[bucket]++;
+    if (hg->count == 0 || ns < hg->min)
+        hg->min = ns;
+    if (ns > hg->max)
+        hg->max = ns;
+    hg->count++;
+    hg->sum += ns;
+}
+
+uint64_t hg_percentile(const struct hg *hg, double percentile)
+{
+    if (hg->count == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * hg->count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HG_BUCKETS; i++)
+    {
+        seen += hg->buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t upper = i == 0 ? 0 : (1ULL << i) - 1;
+            return upper < hg->max ? upper : hg->max;
+        }
+    }
+    return hg->max;
+}
+
+int hg_format(const struct hg *hg, char *buffer, size_t length)
+{
+    char p50[16];
+    char p99[16];
+    char max[16];
+    hg_print_duration(p50, sizeof(p50), hg_percentile(hg, 50));
+    hg_print_duration(p99, sizeof(p99), hg_percentile(hg, 99));
+    hg_print_duration(max, sizeof(max), hg->max);
+    return snprintf(buffer, length, "n=%lu p50=%s p99=%s max=%s", (unsigned long)hg->count, p50, p99, max);
+}
+
+void hg_dump(const struct hg *hg, const char *title, FILE *file)
+{
+    char summary[96];
+    hg_format(hg, summary, sizeof(summary));
+    fprintf(file, "%s: %s\n", title, summary);
+
+    uint64_t peak = 0;
+    for (int i = 0; i < HG_BUCKETS; i++)
+        if (hg->buckets[i] > peak)
+            peak = hg->buckets[i];
+
+    for (int i = 0; i < HG_BUCKETS; i++)
+    {
+        if (hg->buckets[i] == 0)
+            continue;
+        char lower[16];
+        char upper[16];
+        hg_print_duration(lower, sizeof(lower), i == 0 ? 0 : 1ULL << (i - 1));
+        hg_print_duration(upper, sizeof(upper), i == 0 ? 0 : (1ULL << i) - 1);
+        int width = (int)(hg->buckets[i] * BAR_WIDTH / peak);
+        fprintf(file, "  %10s - %-10s %8lu |%.*s\n", lower, upper, (unsigned long)hg->buckets[i], width > 0 ? width : 1,
+                "########################################");
+    }
+}
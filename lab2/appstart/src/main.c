@@ -1,12 +1,25 @@
+#define _GNU_SOURCE
 #include "app_list.h"
+#include "catalog_cache.h"
+#include "fuzzy_filter.h"
+#include "zygote.h"
+#include "event_loop.h"
+#include "control_socket.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 
+#include <sys/epoll.h>
+#include <sys/stat.h>
 #include <sys/signal.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 
@@ -17,36 +30,117 @@
 #define STDIN_BUFFER_SIZE (1024)
 #define DEFAULT_ITEMS_PER_PAGE (10)
 #define STATUS_OPTION_APPEND (1 << 0)
+#define DEFAULT_TIMINGS_FILE "appstart-timings.txt"
+
+/* Bytes of a log read for one page of the log view. */
+#define LOG_PAGE_SIZE (DEFAULT_ITEMS_PER_PAGE * 512)
+
+/* Changes between two frames are coalesced, see paint_frame. */
+#define FRAME_INTERVAL_MS (1000 / 30)
+
+/* Parts of the screen that may have changed since the last frame. */
+#define DIRTY_CONTENT (1 << 0)
+#define DIRTY_INPUT (1 << 1)
+#define DIRTY_STATUS (1 << 2)
+#define DIRTY_SCREEN (1 << 3)
 
 static void quit();
-static int clear_status(void);
+static void clear_status(void);
 static void print_item(struct al_item *item, int index);
 static int next_page(void);
 static int previous_page(void);
 static int page_at(int at);
+static struct al_item *page_start(int at);
+static struct al_item *page_item(int index);
+static void update_max_pages(void);
+static int filter_catalog(const char *query);
 static int close_instances(struct al_item *app);
 static int close_instance(struct al_item *app, pid_t pid);
 static int start_instance(struct al_item *app);
+static int view_output(struct al_item *app, pid_t pid);
+static void print_output(void);
+static void print_lines(const char *buffer, size_t start, size_t length);
+static int view_log(struct al_item *app, pid_t pid);
+static void print_log(void);
+static int page_log(int forward);
+static int show_timings(void);
+static int dump_timings(const char *file);
+static int launch_with_options(const char *arguments);
 static int parse_command(const char buffer[], size_t length);
+static void execute_line(const char buffer[]);
+static void mark_dirty(unsigned int regions);
+static uint64_t item_signature(const struct al_item *item);
+static uint64_t output_signature(void);
+static void paint_content(void);
+static void paint_frame(void);
+static int frame_timeout(void);
+static void read_input(void);
+static void on_stdin(struct el_handler *handler, int fd, uint32_t events, void *data);
+static void on_catalog_update(struct al_catalog *old, struct al_catalog *catalog, void *data);
+static void on_instance_exit(struct al_instance *instance, void *data);
+static void on_usage_sampled(void *data);
+static void on_zygote_exit(int exit_status, void *data);
+static void on_stop_signal(struct el_handler *handler, int fd, uint32_t events, void *data);
+static int run_headless(const char *socket_path, const char *cache_file, const char *dirs, int threads,
+                        int sample_interval);
 
 WINDOW *init_win = NULL;
 WINDOW *main_win = NULL;
 WINDOW *status_win = NULL;
 
+static struct cc_cache cache;
 static struct al_item *root;
 static struct al_item *cur = NULL;
-static struct al_item *next = NULL;
 static int page = 0;
 static int max_pages = 0;
 
+/* Narrows the pages while it has a query, see filter_catalog. */
+static struct ff_filter app_filter;
+
+static char input[STDIN_BUFFER_SIZE];
+static size_t input_length = 0;
+
+/* Instance whose output is shown instead of the page, if any. */
+static struct al_item *viewed_app = NULL;
+static pid_t viewed_pid = 0;
+
+/* Set by SIGINT or SIGTERM in headless mode, ends its event loop. */
+static int stop_requested = 0;
+
+/* Log of the viewed instance, shown instead of its output if open. */
+static struct ol_view log_view = {-1, 0, 0};
+
+/* What the screen shows as of the last frame, to repaint only what differs. */
+struct screen_row
+{
+    uint64_t signature;
+    int end;
+};
+
+static unsigned int dirty = DIRTY_SCREEN;
+static struct timespec last_frame;
+static struct screen_row shown_rows[DEFAULT_ITEMS_PER_PAGE];
+static int shown_count = 0;
+static int shown_page = -1;
+static int shown_max_pages = -1;
+static struct al_item *shown_view = NULL;
+static pid_t shown_view_pid = 0;
+static int shown_view_log = 0;
+static uint64_t shown_output = 0;
+static int footer_row = -1;
+static int input_row = 0;
+
 static void quit()
 {
-    struct al_item *cur = root;
-    while (cur != NULL)
-    {
-        al_dispose(cur);
-        cur = cur->next;
-    }
+    rs_stop();
+    cs_close();
+    ff_dispose(&app_filter);
+    cc_close(&cache);
+    root = NULL;
+    al_unwatch_exits();
+    zy_stop();
+
+    el_dispose();
 
     if (status_win != NULL)
     {
@@ -60,17 +154,28 @@ static void quit()
         main_win = NULL;
     }
 
-    endwin();
+    if (init_win != NULL)
+        endwin();
 }
 
-static int clear_status(void)
+static void clear_status(void)
 {
-    wclear(status_win);
+    werase(status_win);
     wmove(status_win, 0, 0);
+    mark_dirty(DIRTY_STATUS);
 }
 
 static void status(const char *fmt, int options, ...)
 {
+    if (status_win == NULL)
+    {
+        /* Headless, there is no screen to report to. */
+        va_list args;
+        va_start(args, options);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+        return;
+    }
     if (!(options & STATUS_OPTION_APPEND))
     {
         clear_status();
@@ -81,7 +186,7 @@ static void status(const char *fmt, int options, ...)
     vw_printw(status_win, fmt, args);
     va_end(args);
     wattroff(status_win, COLOR_PAIR(5));
-    wrefresh(status_win);
+    mark_dirty(DIRTY_STATUS);
 }
 
 static void print_item(struct al_item *item, int index)
@@ -99,8 +204,24 @@ static void print_item(struct al_item *item, int index)
     struct al_instance *cur = item->instances;
     while (cur != NULL)
     {
-        mvwprintw(main_win, index, x, "(%d)%n", cur->pid, &dpos);
+        if (!cur->exited && cur->usage.samples > 0)
+        {
+            char usage[64];
+            rs_format(&cur->usage, usage, sizeof(usage));
+            mvwprintw(main_win, index, x, "(%d %s)%n", cur->pid, usage, &dpos);
+        }
+        else if (!cur->exited)
+            mvwprintw(main_win, index, x, "(%d)%n", cur->pid, &dpos);
+        else if (WIFSIGNALED(cur->status))
+            mvwprintw(main_win, index, x, "(%d sig %d, %.1fs)%n", cur->pid, WTERMSIG(cur->status), al_instance_runtime(cur), &dpos);
+        else
+            mvwprintw(main_win, index, x, "(%d exit %d, %.1fs)%n", cur->pid, WEXITSTATUS(cur->status), al_instance_runtime(cur), &dpos);
         x += dpos;
+        if (cur->orphans > 0)
+        {
+            mvwprintw(main_win, index, x, " +%d orphans %.1fs%n", cur->orphans, cur->orphan_cpu, &dpos);
+            x += dpos;
+        }
         if ((cur = cur->next) != NULL)
         {
             mvwprintw(main_win, index, x, ", %n", &dpos);
@@ -113,9 +234,10 @@ static void print_item(struct al_item *item, int index)
 
 static int next_page(void)
 {
-    if (next != NULL)
+    struct al_item *tmp = page_start(page + 1);
+    if (tmp != NULL)
     {
-        cur = next;
+        cur = tmp;
         page++;
         return EXIT_SUCCESS;
     }
@@ -128,7 +250,7 @@ static int next_page(void)
 
 static int previous_page(void)
 {
-    struct al_item *tmp = al_skip_pages(cur, -1, DEFAULT_ITEMS_PER_PAGE);
+    struct al_item *tmp = page_start(page - 1);
     if (tmp != NULL)
     {
         cur = tmp;
@@ -144,7 +266,7 @@ static int previous_page(void)
 
 static int page_at(int at)
 {
-    struct al_item *tmp = al_skip_pages(root, at, DEFAULT_ITEMS_PER_PAGE);
+    struct al_item *tmp = page_start(at);
     if (tmp != NULL)
     {
         cur = tmp;
@@ -158,6 +280,58 @@ static int page_at(int at)
     }
 }
 
+/* First item of a page, of the filter matches while filtering. */
+static struct al_item *page_start(int at)
+{
+    if (ff_active(&app_filter))
+        return ff_at(&app_filter, at * DEFAULT_ITEMS_PER_PAGE);
+    return al_skip_pages(root, at, DEFAULT_ITEMS_PER_PAGE);
+}
+
+/* Item at a position of the current page, NULL if there is none. */
+static struct al_item *page_item(int index)
+{
+    if (index < 0 || index >= DEFAULT_ITEMS_PER_PAGE)
+        return NULL;
+    if (ff_active(&app_filter))
+        return ff_at(&app_filter, page * DEFAULT_ITEMS_PER_PAGE + index);
+    return al_at(cur, index);
+}
+
+static void update_max_pages(void)
+{
+    int count = ff_count(&app_filter);
+    max_pages = count / DEFAULT_ITEMS_PER_PAGE + (count % DEFAULT_ITEMS_PER_PAGE == 0 ? 0 : 1);
+    if (page >= max_pages)
+        page = max_pages > 0 ? max_pages - 1 : 0;
+    cur = page_start(page);
+}
+
+/* Narrow the pages to the matches of query, or show all for an empty one. */
+static int filter_catalog(const char *query)
+{
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int count = ff_update(&app_filter, query);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    page = 0;
+    update_max_pages();
+    mark_dirty(DIRTY_CONTENT);
+    if (count < 0)
+    {
+        status("Could not filter the apps!\n", 0);
+        return EXIT_FAILURE;
+    }
+    if (ff_active(&app_filter))
+        status("%d matches for \"%s\" in %.0fus.\n", 0, count, app_filter.query,
+               ((end.tv_sec - start.tv_sec) * 1e9 + end.tv_nsec - start.tv_nsec) / 1e3);
+    else
+        clear_status();
+    return EXIT_SUCCESS;
+}
+
 static int close_instances(struct al_item *app)
 {
     al_close_instances(app);
@@ -166,15 +340,8 @@ static int close_instances(struct al_item *app)
 
 static int close_instance(struct al_item *app, pid_t pid)
 {
-    struct al_instance *cur = app->instances;
-    struct al_instance *found = NULL;
-    while (cur != NULL)
-    {
-        if (cur->pid == pid)
-            found = cur;
-        cur = cur->next;
-    }
-    if (found != NULL)
+    struct al_instance *found = al_find_instance(pid);
+    if (found != NULL && found->app == app)
     {
         al_close_instance(found);
         return EXIT_SUCCESS;
@@ -190,13 +357,222 @@ static int start_instance(struct al_item *app)
     struct al_instance *instance = al_create_instance(app);
     if (instance != NULL)
     {
-        status("pid: %d, stdout: %d, stderr: %d ", STATUS_OPTION_APPEND, instance->pid, instance->stdout, instance->stderr);
+        status("pid: %d, fork: %.1fus, exec: %.1fus ", STATUS_OPTION_APPEND, instance->pid, instance->fork_ns / 1e3,
+               instance->exec_ns / 1e3);
         return EXIT_SUCCESS;
     }
     else
     {
+        status("failed: %s\n", STATUS_OPTION_APPEND, strerror(errno));
+        return EXIT_FAILURE;
+    }
+}
+
+static int view_output(struct al_item *app, pid_t pid)
+{
+    struct al_instance *cur = pid > 0 ? al_find_instance(pid) : app->instances;
+    if (cur == NULL || cur->app != app)
         return EXIT_FAILURE;
+
+    viewed_app = app;
+    viewed_pid = cur->pid;
+    return EXIT_SUCCESS;
+}
+
+static void print_output(void)
+{
+    static char buffer[AL_OUTPUT_BUFFER_SIZE];
+    struct al_instance *instance = al_find_instance(viewed_pid);
+    if (instance != NULL && instance->app != viewed_app)
+        instance = NULL;
+
+    wattron(main_win, COLOR_PAIR(3));
+    if (instance == NULL)
+    {
+        mvwprintw(main_win, 0, 0, "%s (%d) is gone.\n", viewed_app->name, viewed_pid);
+        wclrtobot(main_win);
+        wmove(main_win, DEFAULT_ITEMS_PER_PAGE, 0);
+        wattroff(main_win, COLOR_PAIR(3));
+        return;
+    }
+    wattroff(main_win, COLOR_PAIR(3));
+
+    /* Show the last lines that fit into the page area. */
+    size_t length = rb_peek(&instance->output, 0, buffer, sizeof(buffer));
+    size_t start = length;
+    int lines = 0;
+    if (start > 0 && buffer[start - 1] == '\n')
+        start--;
+    while (start > 0 && lines < DEFAULT_ITEMS_PER_PAGE)
+    {
+        start--;
+        if (buffer[start] == '\n')
+        {
+            lines++;
+            if (lines == DEFAULT_ITEMS_PER_PAGE)
+            {
+                start++;
+                break;
+            }
+        }
     }
+
+    print_lines(buffer, start, length);
+}
+
+/* Fill the page area with the lines from start on, cut to the screen width. */
+static void print_lines(const char *buffer, size_t start, size_t length)
+{
+    int row = 0;
+    while (row < DEFAULT_ITEMS_PER_PAGE)
+    {
+        size_t end = start;
+        while (end < length && buffer[end] != '\n')
+            end++;
+        size_t width = end - start < (size_t)COLS - 1 ? end - start : (size_t)COLS - 1;
+        /* Byte by byte, output may hold NULs that a string would end at. */
+        wmove(main_win, row, 0);
+        for (size_t i = 0; start < length && i < width; i++)
+            waddch(main_win, buffer[start + i] != '\0' ? (unsigned char)buffer[start + i] : '.');
+        waddch(main_win, '\n');
+        start = end < length ? end + 1 : length;
+        row++;
+    }
+    wmove(main_win, DEFAULT_ITEMS_PER_PAGE, 0);
+}
+
+static int view_log(struct al_item *app, pid_t pid)
+{
+    struct al_instance *cur = pid > 0 ? al_find_instance(pid) : app->instances;
+    if (cur == NULL || cur->app != app || cur->log.path == NULL)
+        return EXIT_FAILURE;
+    if (ol_view_open(&log_view, &cur->log) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    viewed_app = app;
+    viewed_pid = cur->pid;
+    return EXIT_SUCCESS;
+}
+
+/* Bound the log view by what the viewed instance has written so far. */
+static void follow_log(void)
+{
+    struct al_instance *instance = viewed_pid > 0 ? al_find_instance(viewed_pid) : NULL;
+    ol_view_follow(&log_view, instance != NULL ? &instance->log : NULL);
+}
+
+/* Show one page of the viewed log, read from the file rather than memory. */
+static void print_log(void)
+{
+    static char buffer[LOG_PAGE_SIZE];
+    follow_log();
+    ssize_t length = ol_view_page(&log_view, buffer, sizeof(buffer), DEFAULT_ITEMS_PER_PAGE);
+    print_lines(buffer, 0, length > 0 ? length : 0);
+}
+
+static int page_log(int forward)
+{
+    follow_log();
+    int moved = forward ? ol_view_next(&log_view, DEFAULT_ITEMS_PER_PAGE)
+                        : ol_view_previous(&log_view, DEFAULT_ITEMS_PER_PAGE);
+    if (moved != EXIT_SUCCESS)
+    {
+        status(forward ? "End of log.\n" : "Start of log.\n", 0);
+        return EXIT_FAILURE;
+    }
+    clear_status();
+    mark_dirty(DIRTY_CONTENT);
+    return EXIT_SUCCESS;
+}
+
+static int show_timings(void)
+{
+    const struct al_launch_timings *timings = al_get_launch_timings();
+    char fork[96];
+    char exec[96];
+    char output[96];
+    hg_format(&timings->fork, fork, sizeof(fork));
+    hg_format(&timings->exec, exec, sizeof(exec));
+    hg_format(&timings->first_output, output, sizeof(output));
+    status("fork %s | exec %s | output %s\n", 0, fork, exec, output);
+    return EXIT_SUCCESS;
+}
+
+static int dump_timings(const char *file)
+{
+    char name[STDIN_BUFFER_SIZE] = DEFAULT_TIMINGS_FILE;
+    sscanf(file, "%s", name);
+
+    FILE *out = fopen(name, "w");
+    if (out == NULL)
+    {
+        status("Could not open %s!\n", 0, name);
+        return EXIT_FAILURE;
+    }
+    const struct al_launch_timings *timings = al_get_launch_timings();
+    hg_dump(&timings->fork, "fork", out);
+    hg_dump(&timings->exec, "exec", out);
+    hg_dump(&timings->first_output, "first output", out);
+    fclose(out);
+    status("Launch timings written to %s.\n", 0, name);
+    return EXIT_SUCCESS;
+}
+
+/* "[item num] [count] option=value ...", see al_parse_launch_option. */
+static int launch_with_options(const char *arguments)
+{
+    char copy[STDIN_BUFFER_SIZE];
+    struct al_launch_options options;
+    struct al_item *sel_item = NULL;
+    int index = 0;
+    int count = 1;
+    int position = 0;
+    char *state;
+
+    al_init_launch_options(&options);
+    snprintf(copy, sizeof(copy), "%s", arguments);
+    for (char *token = strtok_r(copy, " \t\n", &state); token != NULL; token = strtok_r(NULL, " \t\n", &state))
+    {
+        if (strchr(token, '=') == NULL && position < 2)
+        {
+            char *end;
+            long number = strtol(token, &end, 10);
+            if (*end != '\0' || number <= 0)
+            {
+                status("Invalid number: %s\n", 0, token);
+                return EXIT_FAILURE;
+            }
+            if (position++ == 0)
+                index = (int)number;
+            else
+                count = (int)number;
+        }
+        else if (al_parse_launch_option(&options, token) != EXIT_SUCCESS)
+        {
+            status("Invalid option: %s\n", 0, token);
+            return EXIT_FAILURE;
+        }
+    }
+    if ((sel_item = page_item(index - 1)) == NULL)
+    {
+        status("Invalid item!\n", 0);
+        return EXIT_FAILURE;
+    }
+
+    int started = 0;
+    int error = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (al_create_instance_with_options(sel_item, &options) != NULL)
+            started++;
+        else
+            error = errno;
+    }
+    if (started < count)
+        status("Started %d of %d instances of [%d] %s: %s\n", 0, started, count, index, sel_item->name, strerror(error));
+    else
+        status("Started %d instances of [%d] %s.\n", 0, started, index, sel_item->name);
+    return started == count ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 static int parse_command(const char buffer[], size_t length)
@@ -228,9 +604,9 @@ static int parse_command(const char buffer[], size_t length)
             exit(0);
             return EXIT_SUCCESS;
         case 'c':
-            if (1 <= (parsed = sscanf(buffer + i + 1, "%d %d", &index, &pid)) && index > 0 && index <= DEFAULT_ITEMS_PER_PAGE)
+            if (1 <= (parsed = sscanf(buffer + i + 1, "%d %d", &index, &pid)) && page_item(index - 1) != NULL)
             {
-                struct al_item *sel_item = al_at(cur, index - 1);
+                struct al_item *sel_item = page_item(index - 1);
                 if (parsed >= 2)
                 {
                     if (pid > 1 && close_instance(sel_item, pid) == EXIT_SUCCESS)
@@ -256,6 +632,55 @@ static int parse_command(const char buffer[], size_t length)
                 status("Invalid item!\n", 0);
                 return EXIT_FAILURE;
             }
+        case 'o':
+            if (1 <= (parsed = sscanf(buffer + i + 1, "%d %d", &index, &pid)) && page_item(index - 1) != NULL)
+            {
+                struct al_item *sel_item = page_item(index - 1);
+                if (view_output(sel_item, parsed >= 2 ? pid : 0) == EXIT_SUCCESS)
+                {
+                    status("[%u] %s (%d) output, any command returns.\n", 0, index, sel_item->name, viewed_pid);
+                    return EXIT_SUCCESS;
+                }
+                else
+                {
+                    status("No such instance!\n", 0);
+                    return EXIT_FAILURE;
+                }
+            }
+            else
+            {
+                status("Invalid item!\n", 0);
+                return EXIT_FAILURE;
+            }
+        case 'v':
+            if (1 <= (parsed = sscanf(buffer + i + 1, "%d %d", &index, &pid)) && page_item(index - 1) != NULL)
+            {
+                struct al_item *sel_item = page_item(index - 1);
+                if (view_log(sel_item, parsed >= 2 ? pid : 0) == EXIT_SUCCESS)
+                {
+                    status("[%u] %s (%d) log, (n)ext/(p)rev page, any other command returns.\n", 0, index,
+                           sel_item->name, viewed_pid);
+                    return EXIT_SUCCESS;
+                }
+                else
+                {
+                    status("No log for this instance!\n", 0);
+                    return EXIT_FAILURE;
+                }
+            }
+            else
+            {
+                status("Invalid item!\n", 0);
+                return EXIT_FAILURE;
+            }
+        case '/':
+            return filter_catalog(buffer + i + 1);
+        case 'l':
+            return launch_with_options(buffer + i + 1);
+        case 't':
+            return show_timings();
+        case 'd':
+            return dump_timings(buffer + i + 1);
         case ' ':
         case '\t':
         case '\n':
@@ -269,10 +694,446 @@ static int parse_command(const char buffer[], size_t length)
     return EXIT_FAILURE;
 }
 
-int main(void)
+static void execute_line(const char buffer[])
 {
+    unsigned int selection = 0;
+    unsigned int count = 0;
+
+    if (ol_view_active(&log_view))
+    {
+        /* n and p page through the viewed log, anything else leaves it. */
+        if (viewed_app != NULL && (strcmp(buffer, "n") == 0 || strcmp(buffer, "p") == 0))
+        {
+            page_log(buffer[0] == 'n');
+            return;
+        }
+        ol_view_close(&log_view);
+    }
+
+    /* Any command leaves the output view. */
+    viewed_app = NULL;
+    viewed_pid = 0;
+    mark_dirty(DIRTY_CONTENT);
+
+    int parsed = sscanf(buffer, "%u %u", &selection, &count);
+    if (parsed == 2 && page_item(selection - 1) != NULL)
+    {
+        struct al_item *sel_item = page_item(selection - 1);
+        int started = al_create_instances(sel_item, count);
+        status("Started %d of %u instances of [%u] %s.\n", 0, started, count, selection, sel_item->name);
+    }
+    else if (parsed == 1 && page_item(selection - 1) != NULL)
+    {
+        struct al_item *sel_item = page_item(selection - 1);
+        status("Starting: [%u] %s ... ", 0, selection, sel_item->name);
+        if (EXIT_SUCCESS == start_instance(sel_item))
+        {
+            status("done!\n", STATUS_OPTION_APPEND);
+        }
+    }
+    else
+    {
+        parse_command(buffer, strlen(buffer));
+    }
+}
+
+static void mark_dirty(unsigned int regions)
+{
+    dirty |= regions;
+}
+
+/* Hash of everything print_item shows for an item. Running instances change
+ * it with every resource sample, exited ones only once. */
+static uint64_t item_signature(const struct al_item *item)
+{
+    uint64_t hash = 14695981039346656037ULL;
+#define MIX(value) (hash = (hash ^ (uint64_t)(value)) * 1099511628211ULL)
+    MIX((uintptr_t)item);
+    for (const struct al_instance *instance = item->instances; instance != NULL; instance = instance->next)
+    {
+        MIX(instance->pid);
+        MIX(instance->exited);
+        MIX(instance->status);
+        MIX(instance->usage.samples);
+        MIX(instance->orphans);
+    }
+#undef MIX
+    return hash;
+}
+
+/* Bytes the viewed instance wrote so far plus one, 0 once it is gone. */
+static uint64_t output_signature(void)
+{
+    struct al_instance *instance = al_find_instance(viewed_pid);
+    if (instance == NULL || instance->app != viewed_app)
+        return 0;
+    return instance->output.length + instance->output.dropped + 1;
+}
+
+/* Repaint the page rows whose item changed, or the viewed output if it grew.
+ * A row that wraps overwrites the rows below it, those are repainted too. */
+static void paint_content(void)
+{
+    if (viewed_app != NULL && ol_view_active(&log_view))
+    {
+        /* The log only moves when paged. */
+        if (shown_count != -1 || (uint64_t)log_view.offset + 1 != shown_output)
+            print_log();
+        shown_output = log_view.offset + 1;
+        shown_count = -1;
+        return;
+    }
+    if (viewed_app != NULL)
+    {
+        uint64_t signature = output_signature();
+        if (shown_count != -1 || signature != shown_output)
+            print_output();
+        shown_output = signature;
+        shown_count = -1;
+        return;
+    }
+
+    int clobbered = 0;
+    int index = 0;
+    struct al_item *item;
+    while ((item = page_item(index)) != NULL)
+    {
+        struct screen_row *row = &shown_rows[index];
+        uint64_t signature = item_signature(item);
+        if (index >= shown_count || index < clobbered || signature != row->signature)
+        {
+            print_item(item, index);
+            row->signature = signature;
+            row->end = getcury(main_win);
+            if (row->end > clobbered)
+                clobbered = row->end;
+        }
+        index++;
+    }
+    shown_count = index;
+}
+
+/* Bring the screen up to date with the dirty regions in one doupdate. */
+static void paint_frame(void)
+{
+    if (viewed_app != shown_view || viewed_pid != shown_view_pid || ol_view_active(&log_view) != shown_view_log)
+        dirty |= DIRTY_SCREEN;
+    if (dirty & DIRTY_SCREEN)
+    {
+        werase(main_win);
+        shown_count = 0;
+        footer_row = -1;
+        shown_view = viewed_app;
+        shown_view_pid = viewed_pid;
+        shown_view_log = ol_view_active(&log_view);
+        dirty |= DIRTY_CONTENT | DIRTY_INPUT | DIRTY_STATUS;
+    }
+
+    if (dirty & DIRTY_CONTENT)
+        paint_content();
+
+    /* The footer follows the last row, which may have moved. */
+    int row = DEFAULT_ITEMS_PER_PAGE;
+    if (viewed_app == NULL)
+        row = shown_count > 0 ? shown_rows[shown_count - 1].end : 0;
+    if (row != footer_row || page != shown_page || max_pages != shown_max_pages)
+    {
+        wmove(main_win, row, 0);
+        wattron(main_win, COLOR_PAIR(3));
+        wprintw(main_win, "Page: %d/%d\n", page + 1, max_pages);
+        wprintw(main_win, "Commands: [item num] [count], (n)ext page, (p)rev page, #[page num], c[item num] [pid], o[item num] [pid], v[item num] [pid], l[item num] [count] [opt=val], /[filter], (t)imings, d[file], (q)uit\n");
+        wattroff(main_win, COLOR_PAIR(3));
+        footer_row = row;
+        shown_page = page;
+        shown_max_pages = max_pages;
+        input_row = getcury(main_win);
+        dirty |= DIRTY_INPUT;
+    }
+
+    /* The prompt comes last, so the cursor is left behind it. */
+    if (dirty & DIRTY_INPUT)
+    {
+        wmove(main_win, input_row, 0);
+        wattron(main_win, COLOR_PAIR(4));
+        wprintw(main_win, "> %s", input);
+        wattroff(main_win, COLOR_PAIR(4));
+        wclrtobot(main_win);
+    }
+    else
+    {
+        wmove(main_win, input_row, 2 + (int)input_length);
+    }
+
+    if (dirty & DIRTY_STATUS)
+        wnoutrefresh(status_win);
+    wnoutrefresh(main_win);
+    doupdate();
+
+    dirty = 0;
+    clock_gettime(CLOCK_MONOTONIC, &last_frame);
+}
+
+/* Milliseconds until the next frame is due, -1 if nothing changed. */
+static int frame_timeout(void)
+{
+    if (dirty == 0)
+        return -1;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed = (now.tv_sec - last_frame.tv_sec) * 1000 + (now.tv_nsec - last_frame.tv_nsec) / 1000000;
+    return elapsed >= FRAME_INTERVAL_MS ? 0 : (int)(FRAME_INTERVAL_MS - elapsed);
+}
+
+static void read_input(void)
+{
+    int ch;
+    while ((ch = wgetch(main_win)) != ERR)
+    {
+        if (ch == KEY_RESIZE)
+        {
+            mvwin(status_win, getmaxy(init_win) - 1, 0);
+            mark_dirty(DIRTY_SCREEN);
+        }
+        else if (ch == '\n' || ch == '\r' || ch == KEY_ENTER)
+        {
+            input[input_length] = '\0';
+            execute_line(input);
+            input_length = 0;
+            input[0] = '\0';
+            mark_dirty(DIRTY_INPUT);
+        }
+        else if (ch == KEY_BACKSPACE || ch == 127 || ch == '\b')
+        {
+            if (input_length == 0)
+                continue;
+            char removed = input[--input_length];
+            input[input_length] = '\0';
+            mark_dirty(DIRTY_INPUT);
+            /* Deleting the slash of a filter line drops the filter. */
+            if (input[0] == '/' || (input_length == 0 && removed == '/'))
+                filter_catalog(input_length > 0 ? input + 1 : "");
+        }
+        else if (ch >= ' ' && ch < 127 && input_length < STDIN_BUFFER_SIZE - 1)
+        {
+            input[input_length++] = ch;
+            input[input_length] = '\0';
+            mark_dirty(DIRTY_INPUT);
+            /* Filter lines narrow the pages with every keystroke. */
+            if (input[0] == '/')
+                filter_catalog(input + 1);
+        }
+    }
+}
+
+static void on_stdin(struct el_handler *handler, int fd, uint32_t events, void *data)
+{
+    read_input();
+}
+
+static void on_catalog_update(struct al_catalog *old, struct al_catalog *catalog, void *data)
+{
+    cs_set_catalog(catalog);
+    if (main_win == NULL)
+        return;
+    if (ff_set_catalog(&app_filter, catalog) != EXIT_SUCCESS)
+        status("Could not filter the apps!\n", 0);
+    root = al_catalog_at(catalog, 0);
+    update_max_pages();
+
+    if (viewed_app != NULL)
+    {
+        int index = al_catalog_find(catalog, viewed_app->name);
+        viewed_app = index > -1 ? al_catalog_at(catalog, index) : NULL;
+        if (viewed_app == NULL)
+            viewed_pid = 0;
+    }
+    /* Items moved to a new arena, signatures of old rows mean nothing. */
+    mark_dirty(DIRTY_SCREEN);
+}
+
+static void on_instance_exit(struct al_instance *instance, void *data)
+{
+    if (WIFSIGNALED(instance->status))
+        status("%s (%d) killed by signal %d after %.1fs.\n", 0, instance->app->name, instance->pid,
+               WTERMSIG(instance->status), al_instance_runtime(instance));
+    else
+        status("%s (%d) exited with %d after %.1fs.\n", 0, instance->app->name, instance->pid,
+               WEXITSTATUS(instance->status), al_instance_runtime(instance));
+    mark_dirty(DIRTY_CONTENT);
+}
+
+static void on_usage_sampled(void *data)
+{
+    if (viewed_app == NULL)
+        mark_dirty(DIRTY_CONTENT);
+}
+
+static void on_zygote_exit(int exit_status, void *data)
+{
+    if (WIFSIGNALED(exit_status))
+        status("Launcher helper killed by signal %d, forking instead.\n", 0, WTERMSIG(exit_status));
+    else
+        status("Launcher helper exited with %d, forking instead.\n", 0, WEXITSTATUS(exit_status));
+}
+
+static void on_stop_signal(struct el_handler *handler, int fd, uint32_t events, void *data)
+{
+    struct signalfd_siginfo info;
+    while (read(fd, &info, sizeof(info)) > 0)
+        stop_requested = 1;
+}
+
+/* Serve clients of the control socket until SIGINT or SIGTERM, without a
+ * screen. Returning lets quit close the instances and remove the socket. */
+static int run_headless(const char *socket_path, const char *cache_file, const char *dirs, int threads,
+                        int sample_interval)
+{
+    atexit(quit);
+    if (el_init() != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Error while setting up the event loop!\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Instances reset their signal mask, see al_create_instance. */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    int stop_fd = -1;
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0 || (stop_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0 ||
+        el_add(stop_fd, EPOLLIN, on_stop_signal, NULL) == NULL)
+    {
+        fprintf(stderr, "Could not watch for SIGINT and SIGTERM!\n");
+        return EXIT_FAILURE;
+    }
+
+    if (cc_open(&cache, cache_file, dirs, threads) < 0)
+        fprintf(stderr, "Could not read the app directories!\n");
+    else if (cc_watch(&cache, on_catalog_update, NULL) != EXIT_SUCCESS)
+        fprintf(stderr, "Could not watch the app directories!\n");
+    if (al_watch_exits(NULL, NULL) != EXIT_SUCCESS)
+        fprintf(stderr, "Could not watch for exiting instances!\n");
+    if (sample_interval > 0 && rs_start(sample_interval, NULL, NULL) != EXIT_SUCCESS)
+        fprintf(stderr, "Could not sample resource usage!\n");
+
+    if (cs_open(socket_path, &cache) != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Could not listen on %s: %s\n", socket_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    while (!stop_requested)
+    {
+        if (el_run_once(-1) < 0)
+        {
+            fprintf(stderr, "Error while waiting for events!\n");
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/* $XDG_CACHE_HOME/appstart.cache, falling back to ~/.cache. */
+static char *default_cache_file(void)
+{
+    static char file[PATH_MAX];
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (base != NULL && *base != '\0')
+        snprintf(file, sizeof(file), "%s", base);
+    else if (home != NULL && *home != '\0')
+        snprintf(file, sizeof(file), "%s/.cache", home);
+    else
+        return NULL;
+    mkdir(file, 0700);
+
+    size_t length = strlen(file);
+    if (snprintf(file + length, sizeof(file) - length, "/appstart.cache") >= (int)(sizeof(file) - length))
+        return NULL;
+    return file;
+}
+
+int main(int argc, char *argv[])
+{
+    /* Scan every PATH directory by default, one thread per online CPU. */
+    const char *dirs = getenv("PATH");
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *cache_file = default_cache_file();
+    int opt;
+    int zygote = 0;
+    int sample_interval = RS_INTERVAL_MS;
+    const char *socket_path = NULL;
+    const char *log_dir = NULL;
+    long log_rotate_kib = OL_ROTATE_SIZE / 1024;
+    char *end;
+    while ((opt = getopt(argc, argv, "j:c:g:s:H:L:R:z")) != -1)
+    {
+        switch (opt)
+        {
+        case 'z':
+            zygote = 1;
+            break;
+        case 'j':
+            threads = strtol(optarg, NULL, 10);
+            break;
+        case 'c':
+            /* An empty file name disables the cache. */
+            cache_file = *optarg != '\0' ? optarg : NULL;
+            break;
+        case 'g':
+            /* Milliseconds closed instances get before SIGKILL. */
+            al_set_close_grace(strtol(optarg, NULL, 10));
+            break;
+        case 's':
+            /* Milliseconds between resource samples, 0 disables them. */
+            sample_interval = strtol(optarg, NULL, 10);
+            break;
+        case 'L':
+            /* Spool instance output into log files in this directory. */
+            log_dir = optarg;
+            break;
+        case 'R':
+            /* KiB at which those logs are rotated. */
+            errno = 0;
+            log_rotate_kib = strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || errno != 0 || log_rotate_kib <= 0 ||
+                log_rotate_kib > LONG_MAX / 1024)
+            {
+                fprintf(stderr, "Invalid rotation size %s, expected a number of KiB above 0!\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'H':
+            /* Serve the control socket instead of the screen. */
+            socket_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-j threads] [-c cache file] [-g grace ms] [-s sample ms] [-H socket] [-L log dir] [-R rotate KiB] [-z] [dir[:dir...]]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc)
+        dirs = argv[optind];
+    if (log_dir != NULL)
+        al_set_log_dir(log_dir, (off_t)log_rotate_kib * 1024);
+    if (dirs == NULL || *dirs == '\0')
+        dirs = "/usr/bin";
+
+    /* Fork the launcher helper before the catalog and curses grow the heap. */
+    if (zygote && zy_start() != EXIT_SUCCESS)
+    {
+        fprintf(stderr, "Could not start the launcher helper, forking instead.\n");
+    }
+    zy_watch_exit(on_zygote_exit, NULL);
+
+    if (socket_path != NULL)
+        return run_headless(socket_path, cache_file, dirs, (int)threads, sample_interval);
+
     init_win = initscr();
     atexit(quit);
+    cbreak();
+    noecho();
 
     if (has_colors())
     {
@@ -288,55 +1149,59 @@ int main(void)
 
     main_win = newwin(13, COLS, 0, 0);
     status_win = newwin(1, COLS, getmaxy(init_win) - 1, 0);
+    keypad(main_win, TRUE);
+    nodelay(main_win, TRUE);
 
-    char buffer[STDIN_BUFFER_SIZE];
+    if (el_init() != EXIT_SUCCESS || el_add(STDIN_FILENO, EPOLLIN, on_stdin, NULL) == NULL)
+    {
+        status("Error while setting up the event loop!\n", 0);
+        return EXIT_FAILURE;
+    }
 
-    int count = al_search("/usr/bin", &root);
-    cur = root;
-    max_pages = count / DEFAULT_ITEMS_PER_PAGE + (count % DEFAULT_ITEMS_PER_PAGE == 0 ? 0 : 1);
+    int count = cc_open(&cache, cache_file, dirs, (int)threads);
+    if (count < 0)
+    {
+        status("Could not read the app directories!\n", 0);
+        count = 0;
+    }
+    else if (cc_watch(&cache, on_catalog_update, NULL) != EXIT_SUCCESS)
+    {
+        status("Could not watch the app directories!\n", 0);
+    }
+    if (al_watch_exits(on_instance_exit, NULL) != EXIT_SUCCESS)
+    {
+        status("Could not watch for exiting instances!\n", 0);
+    }
+    if (sample_interval > 0 && rs_start(sample_interval, on_usage_sampled, NULL) != EXIT_SUCCESS)
+    {
+        status("Could not sample resource usage!\n", 0);
+    }
+    ff_init(&app_filter);
+    ff_set_catalog(&app_filter, cache.catalog);
+    root = cache.catalog != NULL ? al_catalog_at(cache.catalog, 0) : NULL;
+    update_max_pages();
 
+    mark_dirty(DIRTY_SCREEN);
     while (1)
     {
-        int displayed = 0;
-        next = al_display_page(cur, DEFAULT_ITEMS_PER_PAGE, &displayed, print_item);
-        wattron(main_win, COLOR_PAIR(3));
-        wprintw(main_win, "Page: %d/%d\n", page + 1, max_pages);
-        wprintw(main_win, "Commands: [item num], (n)ext page, (p)rev page, #[page num], c[item num] [pid], (q)uit\n");
-        wattroff(main_win, COLOR_PAIR(3));
-
-        wattron(main_win, COLOR_PAIR(4));
-        wprintw(main_win, "> ");
-        wclrtobot(main_win);
-
-        wrefresh(main_win);
-        int err = wgetnstr(main_win, buffer, STDIN_BUFFER_SIZE);
-        if (OK == err)
+        /* Sleep until the next event, or the next frame if one is pending. */
+        int events = el_run_once(frame_timeout());
+        if (events < 0)
         {
-            wattroff(main_win, COLOR_PAIR(4));
-            unsigned int selection = 0;
-            if (1 == sscanf(buffer, "%u", &selection) && selection <= DEFAULT_ITEMS_PER_PAGE)
-            {
-                struct al_item *sel_item = al_at(cur, selection - 1);
-                status("Starting: [%u] %s ... ", 0, selection, sel_item->name);
-                if (EXIT_SUCCESS == start_instance(sel_item))
-                {
-                    status("done!\n", STATUS_OPTION_APPEND);
-                }
-            }
-            else
-            {
-                parse_command(buffer, STDIN_BUFFER_SIZE);
-            }
+            status("Error while waiting for events!\n", 0);
         }
-        else if (KEY_RESIZE)
+        else if (events == 0)
         {
-            mvwin(status_win, getmaxy(init_win) - 1, 0);
+            /* Interrupted by a signal, e.g. SIGWINCH: let curses handle it. */
+            read_input();
         }
-        else
+        else if (viewed_app != NULL)
         {
-            wattroff(main_win, COLOR_PAIR(4));
-            status("Error while reading input!\n", 0);
+            /* Instance output may have arrived. */
+            mark_dirty(DIRTY_CONTENT);
         }
+        if (frame_timeout() == 0)
+            paint_frame();
     }
 
     return EXIT_SUCCESS;
@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include "output_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Bytes read per step while searching backwards for line starts. */
+#define VIEW_BLOCK_SIZE (4096)
+
+void ol_init(struct ol_log *log)
+{
+    log->path = NULL;
+    log->fd = -1;
+    log->rotate_size = OL_ROTATE_SIZE;
+    log->rotations = 0;
+    log->length = 0;
+    log->window = NULL;
+    log->window_offset = 0;
+}
+
+static int ol_create(struct ol_log *log)
+{
+    log->fd = open(log->path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    log->length = 0;
+    log->window_offset = 0;
+    return log->fd > -1 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int ol_open(struct ol_log *log, const char *path, off_t rotate_size)
+{
+    ol_init(log);
+    log->path = strdup(path);
+    if (log->path == NULL)
+        return EXIT_FAILURE;
+    log->rotate_size = rotate_size > 0 ? rotate_size : 1;
+    if (ol_create(log) != EXIT_SUCCESS)
+    {
+        ol_dispose(log);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int ol_active(const struct ol_log *log)
+{
+    return log->fd > -1;
+}
+
+/* Unmap the current file and cut off the unwritten rest of its last window.
+ * If that fails, the file ends in zeros, which viewing stops at. */
+static int ol_finish(struct ol_log *log)
+{
+    int result = EXIT_SUCCESS;
+    if (log->window != NULL)
+    {
+        munmap(log->window, OL_WINDOW_SIZE);
+        log->window = NULL;
+    }
+    if (log->fd > -1)
+    {
+        if (ftruncate(log->fd, log->length) != 0)
+            result = EXIT_FAILURE;
+        close(log->fd);
+        log->fd = -1;
+    }
+    return result;
+}
+
+/* Map the window starting at offset. Its blocks are allocated up front: a
+ * store into a hole the file system cannot fill would raise SIGBUS. Where
+ * fallocate is not supported, posix_fallocate writes to every block instead,
+ * which is slower but leaves no hole either. */
+static int ol_map(struct ol_log *log, off_t offset)
+{
+    if (log->window != NULL)
+    {
+        munmap(log->window, OL_WINDOW_SIZE);
+        log->window = NULL;
+    }
+
+    int error = posix_fallocate(log->fd, offset, OL_WINDOW_SIZE);
+    if (error != 0)
+    {
+        errno = error;
+        return EXIT_FAILURE;
+    }
+
+    void *window = mmap(NULL, OL_WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, offset);
+    if (window == MAP_FAILED)
+        return EXIT_FAILURE;
+    log->window = window;
+    log->window_offset = offset;
+    return EXIT_SUCCESS;
+}
+
+/* Shift path.1 .. path.(N-1) up by one, dropping path.N, and start over. */
+static int ol_rotate(struct ol_log *log)
+{
+    char from[PATH_MAX];
+    char to[PATH_MAX];
+
+    if (ol_finish(log) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    for (int i = OL_KEEP - 1; i > 0; i--)
+    {
+        snprintf(from, sizeof(from), "%s.%d", log->path, i);
+        snprintf(to, sizeof(to), "%s.%d", log->path, i + 1);
+        rename(from, to);
+    }
+    if (OL_KEEP > 0)
+    {
+        snprintf(to, sizeof(to), "%s.1", log->path);
+        rename(log->path, to);
+    }
+    log->rotations++;
+    return ol_create(log);
+}
+
+int ol_write(struct ol_log *log, const char *buffer, size_t length)
+{
+    if (log->fd < 0)
+        return EXIT_FAILURE;
+
+    while (length > 0)
+    {
+        if (log->length >= log->rotate_size && ol_rotate(log) != EXIT_SUCCESS)
+        {
+            ol_close(log);
+            return EXIT_FAILURE;
+        }
+        if ((log->window == NULL || log->length - log->window_offset == OL_WINDOW_SIZE) &&
+            ol_map(log, log->length) != EXIT_SUCCESS)
+        {
+            ol_close(log);
+            return EXIT_FAILURE;
+        }
+
+        size_t used = log->length - log->window_offset;
+        size_t chunk = OL_WINDOW_SIZE - used;
+        if (chunk > length)
+            chunk = length;
+        if ((off_t)chunk > log->rotate_size - log->length)
+            chunk = log->rotate_size - log->length;
+        memcpy(log->window + used, buffer, chunk);
+        log->length += chunk;
+        buffer += chunk;
+        length -= chunk;
+    }
+    return EXIT_SUCCESS;
+}
+
+int ol_close(struct ol_log *log)
+{
+    return ol_finish(log);
+}
+
+void ol_dispose(struct ol_log *log)
+{
+    ol_finish(log);
+    free(log->path);
+    log->path = NULL;
+}
+
+int ol_view_open(struct ol_view *view, const struct ol_log *log)
+{
+    view->fd = log->path != NULL ? open(log->path, O_RDONLY | O_CLOEXEC) : -1;
+    view->offset = 0;
+    view->length = 0;
+    if (view->fd < 0)
+        return EXIT_FAILURE;
+    ol_view_follow(view, log);
+    return EXIT_SUCCESS;
+}
+
+void ol_view_follow(struct ol_view *view, const struct ol_log *log)
+{
+    struct stat viewed;
+    struct stat written;
+    if (view->fd < 0 || fstat(view->fd, &viewed) != 0)
+        return;
+
+    /* The file still being written ends in the unwritten rest of its window,
+     * a rotated or closed one was cut to what was written. */
+    if (log != NULL && log->fd > -1 && fstat(log->fd, &written) == 0 && written.st_dev == viewed.st_dev &&
+        written.st_ino == viewed.st_ino)
+        view->length = log->length;
+    else
+        view->length = viewed.st_size;
+}
+
+int ol_view_active(const struct ol_view *view)
+{
+    return view->fd > -1;
+}
+
+void ol_view_close(struct ol_view *view)
+{
+    if (view->fd > -1)
+        close(view->fd);
+    view->fd = -1;
+}
+
+ssize_t ol_view_page(struct ol_view *view, char *buffer, size_t length, int lines)
+{
+    if (view->offset >= view->length)
+        return 0;
+    if ((off_t)length > view->length - view->offset)
+        length = view->length - view->offset;
+
+    ssize_t nread;
+    do
+        nread = pread(view->fd, buffer, length, view->offset);
+    while (nread < 0 && errno == EINTR);
+    if (nread < 0)
+        return -1;
+
+    ssize_t size = 0;
+    while (size < nread && lines > 0)
+    {
+        char *newline = memchr(buffer + size, '\n', nread - size);
+        size = newline != NULL ? newline - buffer + 1 : nread;
+        lines--;
+    }
+    return size;
+}
+
+int ol_view_next(struct ol_view *view, int lines)
+{
+    char block[VIEW_BLOCK_SIZE];
+    off_t position = view->offset;
+    while (lines > 0)
+    {
+        off_t left = view->length - position;
+        if (left <= 0)
+            return EXIT_FAILURE;
+        ssize_t nread = pread(view->fd, block, left < (off_t)sizeof(block) ? (size_t)left : sizeof(block), position);
+        if (nread <= 0)
+            return EXIT_FAILURE;
+        ssize_t i = 0;
+        while (i < nread && lines > 0)
+        {
+            if (block[i++] == '\n')
+                lines--;
+        }
+        position += i;
+    }
+
+    /* Only move if something follows. */
+    if (position >= view->length)
+        return EXIT_FAILURE;
+    view->offset = position;
+    return EXIT_SUCCESS;
+}
+
+int ol_view_previous(struct ol_view *view, int lines)
+{
+    if (view->offset == 0)
+        return EXIT_FAILURE;
+
+    /* The byte before the offset ends the previous line, the line starts
+     * after the newline lines lines further back. */
+    char block[VIEW_BLOCK_SIZE];
+    off_t end = view->offset - 1;
+    while (end > 0)
+    {
+        off_t start = end > VIEW_BLOCK_SIZE ? end - VIEW_BLOCK_SIZE : 0;
+        ssize_t nread = pread(view->fd, block, end - start, start);
+        if (nread <= 0)
+            break;
+        for (ssize_t i = nread - 1; i >= 0; i--)
+        {
+            if (block[i] == '\n' && --lines == 0)
+            {
+                view->offset = start + i + 1;
+                return EXIT_SUCCESS;
+            }
+        }
+        end = start;
+    }
+    view->offset = 0;
+    return EXIT_SUCCESS;
+}
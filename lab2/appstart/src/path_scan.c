@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+#include "path_scan.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#include <unistd.h>
+
+/* Layout of the records returned by getdents64, see man 2 getdents. */
+struct ps_dirent64
+{
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* Result of scanning one directory: its executables as NUL-separated names. */
+struct ps_dir
+{
+    char *path;
+    char *names;
+    size_t length;
+    size_t capacity;
+};
+
+struct ps_job
+{
+    struct ps_dir *dirs;
+    int count;
+    int next;
+};
+
+struct ps_credentials
+{
+    uid_t euid;
+    gid_t egid;
+    gid_t *groups;
+    int groups_count;
+};
+
+static struct ps_credentials credentials;
+
+static int ps_in_group(gid_t gid)
+{
+    if (gid == credentials.egid)
+        return 1;
+    for (int i = 0; i < credentials.groups_count; i++)
+        if (credentials.groups[i] == gid)
+            return 1;
+    return 0;
+}
+
+static int ps_executable(const struct stat *st)
+{
+    if (!S_ISREG(st->st_mode))
+        return 0;
+    if (credentials.euid == 0)
+        return (st->st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0;
+    if (st->st_uid == credentials.euid)
+        return (st->st_mode & S_IXUSR) != 0;
+    if (ps_in_group(st->st_gid))
+        return (st->st_mode & S_IXGRP) != 0;
+    return (st->st_mode & S_IXOTH) != 0;
+}
+
+static int ps_dir_add(struct ps_dir *dir, const char *name)
+{
+    size_t length = strlen(name) + 1;
+    if (dir->length + length > dir->capacity)
+    {
+        size_t capacity = dir->capacity > 0 ? dir->capacity * 2 : 16 * 1024;
+        while (capacity < dir->length + length)
+            capacity *= 2;
+        char *names = realloc(dir->names, capacity);
+        if (names == NULL)
+            return EXIT_FAILURE;
+        dir->names = names;
+        dir->capacity = capacity;
+    }
+    memcpy(dir->names + dir->length, name, length);
+    dir->length += length;
+    return EXIT_SUCCESS;
+}
+
+static void ps_scan_dir(struct ps_dir *dir, char *dents)
+{
+    int fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    long nread;
+    while ((nread = syscall(SYS_getdents64, fd, dents, PS_DENTS_BUFFER_SIZE)) > 0)
+    {
+        for (long pos = 0; pos < nread;)
+        {
+            struct ps_dirent64 *entry = (struct ps_dirent64 *)(dents + pos);
+            struct stat st;
+            pos += entry->d_reclen;
+
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+
+            /* Directories, devices, fifos and sockets are never executables.
+             * Everything else needs a stat for its mode, and symlinks are
+             * followed, so dangling ones are dropped here. */
+            if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+                continue;
+            if (fstatat(fd, entry->d_name, &st, 0) != 0 || !ps_executable(&st))
+                continue;
+
+            if (ps_dir_add(dir, entry->d_name) != EXIT_SUCCESS)
+                break;
+        }
+    }
+    close(fd);
+}
+
+static void *ps_worker(void *arg)
+{
+    struct ps_job *job = arg;
+    char *dents = malloc(PS_DENTS_BUFFER_SIZE);
+    if (dents == NULL)
+        return NULL;
+
+    int index;
+    while ((index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count)
+        ps_scan_dir(&job->dirs[index], dents);
+
+    free(dents);
+    return NULL;
+}
+
+static int ps_split(const char *dirs, struct ps_job *job)
+{
+    int capacity = 1;
+    for (const char *c = dirs; *c != '\0'; c++)
+        if (*c == ':')
+            capacity++;
+
+    job->dirs = calloc(capacity, sizeof(struct ps_dir));
+    if (job->dirs == NULL)
+        return EXIT_FAILURE;
+    job->count = 0;
+    job->next = 0;
+
+    const char *start = dirs;
+    while (1)
+    {
+        const char *end = strchrnul(start, ':');
+        if (end > start)
+        {
+            job->dirs[job->count].path = strndup(start, end - start);
+            if (job->dirs[job->count].path == NULL)
+                return EXIT_FAILURE;
+            job->count++;
+        }
+        if (*end == '\0')
+            break;
+        start = end + 1;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void ps_free(struct ps_job *job)
+{
+    if (job->dirs == NULL)
+        return;
+    for (int i = 0; i < job->count; i++)
+    {
+        free(job->dirs[i].path);
+        free(job->dirs[i].names);
+    }
+    free(job->dirs);
+    job->dirs = NULL;
+}
+
+int ps_scan(const char *dirs, int threads, struct al_catalog *catalog)
+{
+    struct ps_job job = {0};
+    int ret = -1;
+
+    credentials.euid = geteuid();
+    credentials.egid = getegid();
+    credentials.groups = NULL;
+    credentials.groups_count = getgroups(0, NULL);
+    if (credentials.groups_count > 0)
+    {
+        credentials.groups = malloc(credentials.groups_count * sizeof(gid_t));
+        if (credentials.groups == NULL)
+            goto out;
+        credentials.groups_count = getgroups(credentials.groups_count, credentials.groups);
+    }
+
+    if (ps_split(dirs, &job) != EXIT_SUCCESS)
+        goto out;
+
+    if (threads > job.count)
+        threads = job.count;
+    pthread_t *workers = NULL;
+    int started = 0;
+    if (threads > 1)
+    {
+        workers = malloc((threads - 1) * sizeof(pthread_t));
+        for (; workers != NULL && started < threads - 1; started++)
+            if (pthread_create(&workers[started], NULL, ps_worker, &job) != 0)
+                break;
+    }
+    /* The calling thread always takes part, so a failed pthread_create only
+     * costs parallelism. */
+    ps_worker(&job);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+    free(workers);
+
+    /* Add in PATH order, so the first directory wins for shadowed names. */
+    for (int i = 0; i < job.count; i++)
+        for (size_t pos = 0; pos < job.dirs[i].length; pos += strlen(job.dirs[i].names + pos) + 1)
+            if (al_catalog_add(catalog, job.dirs[i].path, job.dirs[i].names + pos) != EXIT_SUCCESS)
+                goto out;
+
+    if (al_catalog_finish(catalog) != EXIT_SUCCESS)
+        goto out;
+    ret = catalog->count;
+
+out:
+    ps_free(&job);
+    free(credentials.groups);
+    credentials.groups = NULL;
+    return ret;
+}
+
+int ps_search(const char *dirs, int threads, struct al_item **apps)
+{
+    struct al_catalog *catalog;
+
+    *apps = NULL;
+    catalog = malloc(sizeof(struct al_catalog));
+    if (catalog == NULL)
+        return -1;
+    al_catalog_init(catalog);
+
+    int count = ps_scan(dirs, threads, catalog);
+    if (count <= 0)
+    {
+        al_catalog_dispose(catalog);
+        free(catalog);
+        return count;
+    }
+    *apps = catalog->items;
+    return count;
+}
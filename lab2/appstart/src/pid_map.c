@@ -0,0 +1,110 @@
+#include "pid_map.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static size_t pm_slot(const struct pm *map, pid_t pid)
+{
+    /* Fibonacci hashing spreads consecutive pids over the whole table. */
+    return (size_t)(((uint64_t)(uint32_t)pid * 11400714819323198485ULL) >> 32) & (map->capacity - 1);
+}
+
+static int pm_grow(struct pm *map)
+{
+    struct pm old = *map;
+    size_t capacity = old.capacity > 0 ? old.capacity * 2 : PM_INITIAL_CAPACITY;
+
+    map->entries = calloc(capacity, sizeof(struct pm_entry));
+    if (map->entries == NULL)
+    {
+        map->entries = old.entries;
+        return EXIT_FAILURE;
+    }
+    map->capacity = capacity;
+    map->count = 0;
+
+    for (size_t i = 0; i < old.capacity; i++)
+        if (old.entries[i].pid != 0)
+            pm_put(map, old.entries[i].pid, old.entries[i].value);
+    free(old.entries);
+    return EXIT_SUCCESS;
+}
+
+void pm_init(struct pm *map)
+{
+    map->entries = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+void pm_dispose(struct pm *map)
+{
+    free(map->entries);
+    pm_init(map);
+}
+
+int pm_put(struct pm *map, pid_t pid, void *value)
+{
+    if (pid == 0)
+        return EXIT_FAILURE;
+    if ((map->count + 1) * 2 > map->capacity && pm_grow(map) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    size_t slot = pm_slot(map, pid);
+    while (map->entries[slot].pid != 0 && map->entries[slot].pid != pid)
+        slot = (slot + 1) & (map->capacity - 1);
+
+    if (map->entries[slot].pid == 0)
+        map->count++;
+    map->entries[slot].pid = pid;
+    map->entries[slot].value = value;
+    return EXIT_SUCCESS;
+}
+
+void *pm_get(const struct pm *map, pid_t pid)
+{
+    if (map->capacity == 0 || pid == 0)
+        return NULL;
+
+    size_t slot = pm_slot(map, pid);
+    while (map->entries[slot].pid != 0)
+    {
+        if (map->entries[slot].pid == pid)
+            return map->entries[slot].value;
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return NULL;
+}
+
+void pm_remove(struct pm *map, pid_t pid, const void *value)
+{
+    if (map->capacity == 0 || pid == 0)
+        return;
+
+    size_t mask = map->capacity - 1;
+    size_t slot = pm_slot(map, pid);
+    while (map->entries[slot].pid != pid)
+    {
+        if (map->entries[slot].pid == 0)
+            return;
+        slot = (slot + 1) & mask;
+    }
+    if (map->entries[slot].value != value)
+        return;
+
+    /* Shift following entries back into the hole unless they would move in
+     * front of their home slot. */
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; map->entries[next].pid != 0; next = (next + 1) & mask)
+    {
+        size_t home = pm_slot(map, map->entries[next].pid);
+        if (((next - home) & mask) >= ((next - hole) & mask))
+        {
+            map->entries[hole] = map->entries[next];
+            hole = next;
+        }
+    }
+    map->entries[hole].pid = 0;
+    map->entries[hole].value = NULL;
+    map->count--;
+}
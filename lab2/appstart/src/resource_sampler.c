@@ -0,0 +1,259 @@
+#include "resource_sampler.h"
+#include "event_loop.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+
+#include <unistd.h>
+
+#define RS_STAT_BUFFER_SIZE (1024)
+#define RS_IO_BUFFER_SIZE (512)
+
+/* Fields of /proc/<pid>/stat, counted from 1. */
+#define RS_STAT_UTIME (14)
+#define RS_STAT_STIME (15)
+#define RS_STAT_RSS (24)
+
+static struct rs_usage *attached = NULL;
+static int timer_fd = -1;
+static struct el_handler *timer_handler = NULL;
+static rs_callback sampled_callback = NULL;
+static void *sampled_data = NULL;
+
+/* Files kept open across samples and how many may be, see RS_FD_SHARE. */
+static int persistent_fds = 0;
+static int persistent_limit = -1;
+
+static int rs_persistent_limit(void)
+{
+    if (persistent_limit < 0)
+    {
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY)
+            persistent_limit = 0;
+        else
+            persistent_limit = (int)(limit.rlim_cur / RS_FD_SHARE);
+    }
+    return persistent_limit;
+}
+
+static void rs_close(int *fd)
+{
+    if (*fd > -1)
+    {
+        close(*fd);
+        *fd = -1;
+        persistent_fds--;
+    }
+}
+
+/* Read a /proc file of the process through its persistent fd, opening one if
+ * the budget allows, or through a temporary one otherwise. */
+static ssize_t rs_read(struct rs_usage *usage, int *fd, const char *file, char *buffer, size_t length)
+{
+    int temporary = -1;
+    if (*fd < 0)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/%s", (int)usage->pid, file);
+        temporary = open(path, O_RDONLY | O_CLOEXEC);
+        if (temporary < 0)
+            return -1;
+        if (persistent_fds < rs_persistent_limit())
+        {
+            *fd = temporary;
+            temporary = -1;
+            persistent_fds++;
+        }
+    }
+
+    ssize_t count = pread(temporary > -1 ? temporary : *fd, buffer, length - 1, 0);
+    if (temporary > -1)
+        close(temporary);
+    if (count < 0)
+        return -1;
+    buffer[count] = '\0';
+    return count;
+}
+
+static int rs_parse_stat(const char *buffer, uint64_t *ticks, uint64_t *rss_pages)
+{
+    /* The command name may contain spaces and parentheses, so count fields
+     * from the last closing one, which ends field 2. */
+    const char *at = strrchr(buffer, ')');
+    if (at == NULL)
+        return EXIT_FAILURE;
+
+    uint64_t utime = 0;
+    uint64_t stime = 0;
+    int field = 2;
+    at++;
+    while (*at != '\0' && field < RS_STAT_RSS)
+    {
+        while (*at == ' ')
+            at++;
+        field++;
+        char *end;
+        if (field == RS_STAT_UTIME)
+            utime = strtoull(at, &end, 10);
+        else if (field == RS_STAT_STIME)
+            stime = strtoull(at, &end, 10);
+        else if (field == RS_STAT_RSS)
+            *rss_pages = strtoull(at, &end, 10);
+        while (*at != ' ' && *at != '\0')
+            at++;
+    }
+    if (field < RS_STAT_RSS)
+        return EXIT_FAILURE;
+    *ticks = utime + stime;
+    return EXIT_SUCCESS;
+}
+
+int rs_sample(struct rs_usage *usage)
+{
+    static long ticks_per_second = 0;
+    static long page_size = 0;
+    char buffer[RS_STAT_BUFFER_SIZE];
+    uint64_t ticks;
+    uint64_t rss_pages;
+
+    if (ticks_per_second == 0)
+    {
+        ticks_per_second = sysconf(_SC_CLK_TCK);
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+
+    if (rs_read(usage, &usage->stat_fd, "stat", buffer, sizeof(buffer)) < 0 ||
+        rs_parse_stat(buffer, &ticks, &rss_pages) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (usage->samples > 0)
+    {
+        double elapsed = (now.tv_sec - usage->sampled.tv_sec) + (now.tv_nsec - usage->sampled.tv_nsec) / 1e9;
+        if (elapsed > 0)
+            usage->cpu_percent = (ticks - usage->cpu_ticks) * 100.0 / ticks_per_second / elapsed;
+    }
+    usage->cpu_ticks = ticks;
+    usage->rss_bytes = rss_pages * page_size;
+    usage->sampled = now;
+    usage->samples++;
+
+    /* Not readable for processes that changed credentials, so optional. */
+    char io[RS_IO_BUFFER_SIZE];
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    if (rs_read(usage, &usage->io_fd, "io", io, sizeof(io)) > 0 &&
+        sscanf(io, "rchar: %llu wchar: %llu", &read_bytes, &write_bytes) == 2)
+    {
+        usage->read_bytes = read_bytes;
+        usage->write_bytes = write_bytes;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void rs_on_timer(struct el_handler *handler, int fd, uint32_t events, void *data)
+{
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    for (struct rs_usage *usage = attached; usage != NULL; usage = usage->next)
+        rs_sample(usage);
+    if (sampled_callback != NULL)
+        sampled_callback(sampled_data);
+}
+
+int rs_start(int interval_ms, rs_callback callback, void *data)
+{
+    if (timer_fd > -1 || interval_ms <= 0)
+        return EXIT_FAILURE;
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+        return EXIT_FAILURE;
+
+    struct timespec interval = {.tv_sec = interval_ms / 1000, .tv_nsec = (interval_ms % 1000) * 1000000L};
+    struct itimerspec spec = {.it_interval = interval, .it_value = interval};
+    if (timerfd_settime(timer_fd, 0, &spec, NULL) != 0 ||
+        (timer_handler = el_add(timer_fd, EPOLLIN, rs_on_timer, NULL)) == NULL)
+    {
+        close(timer_fd);
+        timer_fd = -1;
+        return EXIT_FAILURE;
+    }
+    sampled_callback = callback;
+    sampled_data = data;
+    return EXIT_SUCCESS;
+}
+
+void rs_stop(void)
+{
+    if (timer_fd < 0)
+        return;
+    el_remove(timer_handler);
+    timer_handler = NULL;
+    close(timer_fd);
+    timer_fd = -1;
+    sampled_callback = NULL;
+    sampled_data = NULL;
+}
+
+void rs_attach(struct rs_usage *usage, pid_t pid)
+{
+    memset(usage, 0, sizeof(struct rs_usage));
+    usage->pid = pid;
+    usage->stat_fd = -1;
+    usage->io_fd = -1;
+    usage->attached = 1;
+    usage->next = attached;
+    if (attached != NULL)
+        attached->previous = usage;
+    attached = usage;
+}
+
+void rs_detach(struct rs_usage *usage)
+{
+    if (!usage->attached)
+        return;
+    rs_close(&usage->stat_fd);
+    rs_close(&usage->io_fd);
+    if (usage->next != NULL)
+        usage->next->previous = usage->previous;
+    if (usage->previous != NULL)
+        usage->previous->next = usage->next;
+    else
+        attached = usage->next;
+    usage->next = NULL;
+    usage->previous = NULL;
+    usage->attached = 0;
+}
+
+static int rs_print_bytes(char *buffer, size_t length, uint64_t bytes)
+{
+    if (bytes < 1024)
+        return snprintf(buffer, length, "%lu", (unsigned long)bytes);
+    if (bytes < 1024 * 1024)
+        return snprintf(buffer, length, "%luK", (unsigned long)(bytes >> 10));
+    if (bytes < 1024ULL * 1024 * 1024)
+        return snprintf(buffer, length, "%.1fM", bytes / 1048576.0);
+    return snprintf(buffer, length, "%.1fG", bytes / 1073741824.0);
+}
+
+int rs_format(const struct rs_usage *usage, char *buffer, size_t length)
+{
+    char rss[16];
+    char in[16];
+    char out[16];
+    rs_print_bytes(rss, sizeof(rss), usage->rss_bytes);
+    rs_print_bytes(in, sizeof(in), usage->read_bytes);
+    rs_print_bytes(out, sizeof(out), usage->write_bytes);
+    return snprintf(buffer, length, "%.1f%% %s r%s w%s", usage->cpu_percent, rss, in, out);
+}
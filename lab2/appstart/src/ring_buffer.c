@@ -0,0 +1,72 @@
+#include "ring_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void rb_init(struct rb *rb, size_t size)
+{
+    rb->data = NULL;
+    rb->size = size;
+    rb->head = 0;
+    rb->length = 0;
+    rb->dropped = 0;
+}
+
+void rb_dispose(struct rb *rb)
+{
+    free(rb->data);
+    rb->data = NULL;
+    rb->head = 0;
+    rb->length = 0;
+}
+
+int rb_write(struct rb *rb, const char *buffer, size_t length)
+{
+    if (rb->data == NULL)
+    {
+        rb->data = malloc(rb->size);
+        if (rb->data == NULL)
+            return EXIT_FAILURE;
+    }
+
+    /* Only the last size bytes can survive anyway. */
+    if (length > rb->size)
+    {
+        rb->dropped += length - rb->size;
+        buffer += length - rb->size;
+        length = rb->size;
+    }
+
+    size_t tail = (rb->head + rb->length) % rb->size;
+    size_t first = rb->size - tail;
+    if (first > length)
+        first = length;
+    memcpy(rb->data + tail, buffer, first);
+    memcpy(rb->data, buffer + first, length - first);
+
+    rb->length += length;
+    if (rb->length > rb->size)
+    {
+        size_t overwritten = rb->length - rb->size;
+        rb->dropped += overwritten;
+        rb->head = (rb->head + overwritten) % rb->size;
+        rb->length = rb->size;
+    }
+    return EXIT_SUCCESS;
+}
+
+size_t rb_peek(const struct rb *rb, size_t offset, char *buffer, size_t length)
+{
+    if (rb->data == NULL || offset >= rb->length)
+        return 0;
+    if (length > rb->length - offset)
+        length = rb->length - offset;
+
+    size_t start = (rb->head + offset) % rb->size;
+    size_t first = rb->size - start;
+    if (first > length)
+        first = length;
+    memcpy(buffer, rb->data + start, first);
+    memcpy(buffer + first, rb->data, length - first);
+    return length;
+}
@@ -0,0 +1,295 @@
+#define _GNU_SOURCE
+#include "zygote.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include <unistd.h>
+
+#define ZY_STACK_SIZE (64 * 1024)
+
+struct zy_reply
+{
+    pid_t pid;
+    int error;
+    uint64_t fork_ns;
+    uint64_t exec_ns;
+};
+
+struct zy_spawn
+{
+    const char *path;
+    const char *name;
+    int stdout_link[2];
+    int stderr_link[2];
+    volatile int error;
+    struct timespec forked;
+};
+
+static uint64_t zy_elapsed_ns(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000000ULL + to->tv_nsec - from->tv_nsec;
+}
+
+static int zygote_fd = -1;
+static pid_t zygote_pid = -1;
+static zy_exit_callback exit_callback = NULL;
+static void *exit_data = NULL;
+
+static int zy_pipes(struct zy_spawn *spawn)
+{
+    /* O_CLOEXEC keeps them out of every other spawned app. */
+    if (pipe2(spawn->stdout_link, O_CLOEXEC) != 0)
+        return EXIT_FAILURE;
+    if (pipe2(spawn->stderr_link, O_CLOEXEC) != 0)
+    {
+        close(spawn->stdout_link[0]);
+        close(spawn->stdout_link[1]);
+        spawn->stdout_link[0] = -1;
+        spawn->stdout_link[1] = -1;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void zy_close_pipes(struct zy_spawn *spawn)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (spawn->stdout_link[i] > -1)
+            close(spawn->stdout_link[i]);
+        if (spawn->stderr_link[i] > -1)
+            close(spawn->stderr_link[i]);
+        spawn->stdout_link[i] = -1;
+        spawn->stderr_link[i] = -1;
+    }
+}
+
+static int zy_child(void *arg)
+{
+    struct zy_spawn *spawn = arg;
+    sigset_t mask;
+
+    clock_gettime(CLOCK_MONOTONIC, &spawn->forked);
+    dup2(spawn->stdout_link[1], STDOUT_FILENO);
+    dup2(spawn->stderr_link[1], STDERR_FILENO);
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    setpgid(0, 0);
+
+    execl(spawn->path, spawn->name, NULL);
+
+    /* The memory is shared with the helper, which is suspended until now. */
+    spawn->error = errno;
+    _exit(127);
+}
+
+static void zy_serve(int fd)
+{
+    static char stack[ZY_STACK_SIZE] __attribute__((aligned(16)));
+    struct zy_spawn pool[ZY_POOL_SIZE];
+    int pooled = 0;
+    char request[2 * PATH_MAX];
+
+    /* The helper is of no use once appstart is gone. */
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    while (1)
+    {
+        while (pooled < ZY_POOL_SIZE && zy_pipes(&pool[pooled]) == EXIT_SUCCESS)
+            pooled++;
+
+        ssize_t length = recv(fd, request, sizeof(request) - 1, 0);
+        if (length <= 0)
+            break;
+        request[length] = '\0';
+
+        /* The request is "path\0name\0". */
+        struct zy_spawn spawn = {.stdout_link = {-1, -1}, .stderr_link = {-1, -1}, .error = 0};
+        struct zy_reply reply = {.pid = -1, .error = 0, .fork_ns = 0, .exec_ns = 0};
+        spawn.path = request;
+        spawn.name = request + strlen(request) + 1;
+        if (spawn.name >= request + length)
+            spawn.name = spawn.path;
+
+        if (pooled > 0)
+        {
+            pooled--;
+            memcpy(spawn.stdout_link, pool[pooled].stdout_link, sizeof(spawn.stdout_link));
+            memcpy(spawn.stderr_link, pool[pooled].stderr_link, sizeof(spawn.stderr_link));
+        }
+        else if (zy_pipes(&spawn) != EXIT_SUCCESS)
+        {
+            reply.error = errno;
+        }
+
+        /* CLONE_VFORK suspends the helper until the child called execl, and
+         * CLONE_PARENT makes the child a sibling, so appstart reaps it. */
+        if (reply.error == 0)
+        {
+            struct timespec start;
+            struct timespec end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            reply.pid = clone(zy_child, stack + sizeof(stack), CLONE_VM | CLONE_VFORK | CLONE_PARENT | SIGCHLD, &spawn);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (reply.pid < 0)
+            {
+                reply.error = errno;
+            }
+            else
+            {
+                reply.error = spawn.error;
+                reply.fork_ns = zy_elapsed_ns(&start, &spawn.forked);
+                reply.exec_ns = zy_elapsed_ns(&spawn.forked, &end);
+            }
+        }
+
+        char control[CMSG_SPACE(2 * sizeof(int))];
+        struct iovec iov = {.iov_base = &reply, .iov_len = sizeof(reply)};
+        struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1};
+        if (reply.error == 0)
+        {
+            int fds[2] = {spawn.stdout_link[0], spawn.stderr_link[0]};
+            memset(control, 0, sizeof(control));
+            message.msg_control = control;
+            message.msg_controllen = sizeof(control);
+            struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(fds));
+            memcpy(CMSG_DATA(header), fds, sizeof(fds));
+        }
+        sendmsg(fd, &message, MSG_NOSIGNAL);
+        zy_close_pipes(&spawn);
+    }
+
+    for (int i = 0; i < pooled; i++)
+        zy_close_pipes(&pool[i]);
+    _exit(EXIT_SUCCESS);
+}
+
+int zy_start(void)
+{
+    int fds[2];
+    if (zygote_fd > -1)
+        return EXIT_SUCCESS;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0)
+        return EXIT_FAILURE;
+
+    zygote_pid = fork();
+    if (zygote_pid == 0)
+    {
+        close(fds[0]);
+        zy_serve(fds[1]);
+    }
+    close(fds[1]);
+    if (zygote_pid < 0)
+    {
+        close(fds[0]);
+        return EXIT_FAILURE;
+    }
+    zygote_fd = fds[0];
+    return EXIT_SUCCESS;
+}
+
+int zy_active(void)
+{
+    return zygote_fd > -1;
+}
+
+pid_t zy_pid(void)
+{
+    return zygote_pid;
+}
+
+void zy_watch_exit(zy_exit_callback callback, void *data)
+{
+    exit_callback = callback;
+    exit_data = data;
+}
+
+int zy_reap(void)
+{
+    int status;
+    if (zygote_pid < 0 || waitpid(zygote_pid, &status, WNOHANG) != zygote_pid)
+        return EXIT_FAILURE;
+    close(zygote_fd);
+    zygote_fd = -1;
+    zygote_pid = -1;
+    if (exit_callback != NULL)
+        exit_callback(status, exit_data);
+    return EXIT_SUCCESS;
+}
+
+int zy_request(const char *path, const char *name)
+{
+    size_t path_length = strlen(path) + 1;
+    size_t name_length = strlen(name) + 1;
+    if (zygote_fd < 0 || path_length + name_length > 2 * PATH_MAX - 1)
+        return EXIT_FAILURE;
+
+    struct iovec iov[] = {
+        {.iov_base = (void *)path, .iov_len = path_length},
+        {.iov_base = (void *)name, .iov_len = name_length},
+    };
+    struct msghdr message = {.msg_iov = iov, .msg_iovlen = 2};
+    return sendmsg(zygote_fd, &message, MSG_NOSIGNAL) == (ssize_t)(path_length + name_length) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+pid_t zy_receive(int *stdout_fd, int *stderr_fd, uint64_t *fork_ns, uint64_t *exec_ns)
+{
+    struct zy_reply reply;
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov = {.iov_base = &reply, .iov_len = sizeof(reply)};
+    struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+
+    ssize_t length;
+    while ((length = recvmsg(zygote_fd, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+        ;
+    if (length != sizeof(reply))
+    {
+        errno = length < 0 ? errno : EPROTO;
+        return -1;
+    }
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (reply.error != 0 || header == NULL || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(2 * sizeof(int)))
+    {
+        /* A child that failed to exec is ours to reap. */
+        if (reply.pid > 0)
+            waitpid(reply.pid, NULL, 0);
+        errno = reply.error != 0 ? reply.error : EPROTO;
+        return -1;
+    }
+
+    int fds[2];
+    memcpy(fds, CMSG_DATA(header), sizeof(fds));
+    *stdout_fd = fds[0];
+    *stderr_fd = fds[1];
+    *fork_ns = reply.fork_ns;
+    *exec_ns = reply.exec_ns;
+    return reply.pid;
+}
+
+void zy_stop(void)
+{
+    if (zygote_fd < 0)
+        return;
+    close(zygote_fd);
+    zygote_fd = -1;
+    waitpid(zygote_pid, NULL, 0);
+    zygote_pid = -1;
+}
@@ -20,8 +20,6 @@
 
 #include "bench_utils.h"
 
-#define SLEEP_TIME 1
-
 // #define USE_MEMSET
 // #define USE_COPY_BUFFER
 
@@ -36,6 +34,7 @@ int main(int argc, char *argv[])
     pid_t pid = getpid();
     pid_t pid_child;
     char *anon;
+    struct bench_barrier *barrier;
     int i;
 
     /**
@@ -49,6 +48,10 @@ int main(int argc, char *argv[])
     if (anon == MAP_FAILED)
         ERROR("mmap anon", errno);
 
+    barrier = bench_barrier_create(2);
+    if (NULL == barrier)
+        ERROR("bench_barrier_create", errno);
+
     int ret = pid_child = fork();
 
     if (-1 == ret)
@@ -64,8 +67,14 @@ int main(int argc, char *argv[])
         memset(buffer, 0, MAX_SIZE);
         pid_child = getpid();
         memcpy(anon, buffer, MAX_SIZE);
-        pause();
-        printf("PID %d (CHILD): COPY DONE\n", pid_child);
+
+        /* Follow the parent through the start and stop of every measured phase. */
+        for (i = 0; i < sizes_num; i++)
+        {
+            bench_barrier_wait(barrier);
+            bench_barrier_wait(barrier);
+        }
+        DEBUG(printf("PID %d (CHILD): COPY DONE\n", pid_child));
         return (EXIT_SUCCESS);
     }
 
@@ -97,8 +106,10 @@ int main(int argc, char *argv[])
         struct timeval tv_start;
         struct timeval tv_stop;
         double time_delta_sec;
+        double mb_per_sec;
+        double ceiling;
 
-        sleep(SLEEP_TIME);
+        bench_barrier_wait(barrier);
 
         gettimeofday(&tv_start, NULL);
         for (j = 0; j < MEASUREMENTS; j++)
@@ -130,6 +141,8 @@ int main(int argc, char *argv[])
         }
         gettimeofday(&tv_stop, NULL);
 
+        bench_barrier_wait(barrier);
+
         min_ticks = INT_MAX;
         max_ticks = INT_MIN;
         ticks_all = 0;
@@ -145,15 +158,17 @@ int main(int argc, char *argv[])
         ticks_all -= max_ticks;
 
         time_delta_sec = ((tv_stop.tv_sec - tv_start.tv_sec) + ((tv_stop.tv_usec - tv_start.tv_usec) / (1000.0 * 1000.0)));
+        mb_per_sec = ((double)current_size * MEASUREMENTS) / (1024.0 * 1024.0 * time_delta_sec);
+        ceiling = bench_memcpy_ceiling(current_size);
 
-        printf("PID:%d time: min:%d max:%d Ticks Avg without min/max:%f Ticks (for %d measurements) for %d Bytes (%.2f MB/s)\n",
+        printf("PID:%d time: min:%d max:%d Ticks Avg without min/max:%f Ticks (for %d measurements) for %d Bytes (%.2f MB/s) %.1f%% of memcpy (%.2f MB/s)\n",
                pid, min_ticks, max_ticks,
                (double)ticks_all / (MEASUREMENTS - 2.0), MEASUREMENTS, current_size,
-               ((double)current_size * MEASUREMENTS) / (1024.0 * 1024.0 * time_delta_sec));
+               mb_per_sec, 100.0 * mb_per_sec / ceiling, ceiling);
     }
 
-    kill(pid_child, SIGTERM);
     wait(NULL);
+    bench_barrier_destroy(barrier);
     munmap(anon, MAX_SIZE);
 
     return (EXIT_SUCCESS);
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -10,11 +11,355 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 
 #include "bench_utils.h"
 
+/*
+ * Batched small-message mode: K logical messages are coalesced into a single
+ * syscall, writev() on a pipe or sendmmsg() on a SOCK_DGRAM socketpair.
+ * For every message size, the batch size K is swept, and the per-message cost
+ * is reported next to the achieved message rate and throughput.
+ */
+static int bench_batched(int use_socket)
+{
+    const int sizes[] = {16, 64, 256, 1024};
+    const int sizes_num = sizeof(sizes) / sizeof(sizes[0]);
+    const int batches[] = {1, 2, 4, 8, 16, 32, 64};
+    const int batches_num = sizeof(batches) / sizeof(batches[0]);
+#define MAX_MSG_SIZE sizes[sizes_num - 1]
+#define MAX_BATCH batches[batches_num - 1]
+    struct iovec iov[MAX_BATCH];
+    struct mmsghdr msgs[MAX_BATCH];
+    int fds[2];
+    char *buffer;
+    struct bench_barrier *barrier;
+    pid_t pid;
+    int ret;
+
+    if (use_socket)
+        ret = socketpair(AF_UNIX, SOCK_DGRAM, 0, fds);
+    else
+        ret = pipe(fds);
+    if (-1 == ret)
+        ERROR(use_socket ? "socketpair" : "pipe", errno);
+
+    barrier = bench_barrier_create(2);
+    if (NULL == barrier)
+        ERROR("bench_barrier_create", errno);
+
+    buffer = malloc(MAX_MSG_SIZE * MAX_BATCH);
+    if (NULL == buffer)
+        ERROR("malloc", ENOMEM);
+    memset(buffer, 'a', MAX_MSG_SIZE * MAX_BATCH);
+
+    pid = getpid();
+    ret = fork();
+    if (-1 == ret)
+        ERROR("fork", errno);
+
+    if (0 == ret)
+    {
+        /* CHILD Process: receives exactly what the parent sends per phase */
+        close(fds[1]);
+
+        for (int i = 0; i < sizes_num; i++)
+            for (int b = 0; b < batches_num; b++)
+            {
+                int current_size = sizes[i];
+                int messages = (MEASUREMENTS / batches[b]) * batches[b];
+
+                bench_barrier_wait(barrier);
+                if (use_socket)
+                {
+                    for (int k = 0; k < MAX_BATCH; k++)
+                    {
+                        iov[k].iov_base = buffer + k * MAX_MSG_SIZE;
+                        iov[k].iov_len = MAX_MSG_SIZE;
+                        memset(&msgs[k].msg_hdr, 0, sizeof(msgs[k].msg_hdr));
+                        msgs[k].msg_hdr.msg_iov = &iov[k];
+                        msgs[k].msg_hdr.msg_iovlen = 1;
+                    }
+                    while (messages > 0)
+                    {
+                        int nrecv = recvmmsg(fds[0], msgs, messages < MAX_BATCH ? messages : MAX_BATCH,
+                                             MSG_WAITFORONE, NULL);
+                        if (-1 == nrecv)
+                            ERROR("recvmmsg", errno);
+                        messages -= nrecv;
+                    }
+                }
+                else
+                {
+                    long long remaining = (long long)messages * current_size;
+                    while (remaining > 0)
+                    {
+                        int nread = read(fds[0], buffer,
+                                         remaining < MAX_MSG_SIZE * MAX_BATCH ? remaining : MAX_MSG_SIZE * MAX_BATCH);
+                        if (-1 == nread)
+                            ERROR("read", errno);
+                        remaining -= nread;
+                    }
+                }
+                bench_barrier_wait(barrier);
+            }
+
+        close(fds[0]);
+        return EXIT_SUCCESS;
+    }
+
+    int *ticks;
+
+    ticks = malloc(MEASUREMENTS * sizeof(int));
+    if (NULL == ticks)
+        ERROR("malloc", ENOMEM);
+    memset(ticks, 0, MEASUREMENTS * sizeof(int));
+
+    close(fds[0]);
+
+    for (int i = 0; i < sizes_num; i++)
+    {
+        double ceiling = bench_memcpy_ceiling(sizes[i]);
+
+        for (int b = 0; b < batches_num; b++)
+        {
+            int current_size = sizes[i];
+            int batch = batches[b];
+            int batches_sent = MEASUREMENTS / batch;
+            int j;
+            int min_ticks;
+            int max_ticks;
+            long long ticks_all;
+            double ticks_avg;
+            struct timeval tv_start;
+            struct timeval tv_stop;
+            double time_delta_sec;
+            double mb_per_sec;
+
+            for (int k = 0; k < batch; k++)
+            {
+                iov[k].iov_base = buffer + k * current_size;
+                iov[k].iov_len = current_size;
+                memset(&msgs[k].msg_hdr, 0, sizeof(msgs[k].msg_hdr));
+                msgs[k].msg_hdr.msg_iov = &iov[k];
+                msgs[k].msg_hdr.msg_iovlen = 1;
+            }
+
+            bench_barrier_wait(barrier);
+
+            gettimeofday(&tv_start, NULL);
+            for (j = 0; j < batches_sent; j++)
+            {
+                unsigned long long start;
+                unsigned long long stop;
+                int nsent;
+                start = getrdtsc();
+                if (use_socket)
+                    nsent = sendmmsg(fds[1], msgs, batch, 0);
+                else
+                    nsent = writev(fds[1], iov, batch);
+                stop = getrdtsc();
+                assert(nsent == (use_socket ? batch : batch * current_size));
+                ticks[j] = stop - start;
+            }
+            gettimeofday(&tv_stop, NULL);
+
+            bench_barrier_wait(barrier);
+
+            min_ticks = INT_MAX;
+            max_ticks = INT_MIN;
+            ticks_all = 0;
+            for (j = 0; j < batches_sent; j++)
+            {
+                if (min_ticks > ticks[j])
+                    min_ticks = ticks[j];
+                if (max_ticks < ticks[j])
+                    max_ticks = ticks[j];
+                ticks_all += ticks[j];
+            }
+            ticks_all -= min_ticks;
+            ticks_all -= max_ticks;
+            ticks_avg = (double)ticks_all / (batches_sent - 2.0);
+
+            time_delta_sec = ((tv_stop.tv_sec - tv_start.tv_sec) + ((tv_stop.tv_usec - tv_start.tv_usec) / (1000.0 * 1000.0)));
+            mb_per_sec = ((double)current_size * batches_sent * batch) / (1024.0 * 1024.0 * time_delta_sec);
+
+            // The per-batch average is the delay a message may see before its
+            // batch is flushed; the per-message average is the amortized cost.
+            printf("PID:%d %s batch:%d time: min:%d max:%d Ticks Avg without min/max:%f Ticks per batch, %f Ticks per message (for %d batches) for %d Bytes (%.2f MB/s, %.0f msgs/s) %.1f%% of memcpy (%.2f MB/s)\n",
+                   pid, use_socket ? "sendmmsg" : "writev", batch, min_ticks, max_ticks,
+                   ticks_avg, ticks_avg / batch, batches_sent, current_size,
+                   mb_per_sec, (double)batches_sent * batch / time_delta_sec,
+                   100.0 * mb_per_sec / ceiling, ceiling);
+        }
+    }
+
+    close(fds[1]);
+    wait(NULL);
+    bench_barrier_destroy(barrier);
+    free(ticks);
+    free(buffer);
+
+    return EXIT_SUCCESS;
+#undef MAX_MSG_SIZE
+#undef MAX_BATCH
+}
+
+/*
+ * One-way mode: every message carries the sender's TSC in a
+ * bench_oneway_header, and the receiver computes the delivery latency once
+ * the message was read completely. The sender waits for the receiver's
+ * acknowledgement before the next message, so only one is ever in flight.
+ * Both sides are pinned to different cores, which requires an invariant TSC
+ * to give comparable timestamps.
+ * The receiver's statistics are handed back to the parent via shared memory.
+ */
+static int bench_oneway(void)
+{
+    const int sizes[] = {
+        128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768,
+        65536, 131072, 262144, 524288, 1048576};
+    const int sizes_num = sizeof(sizes) / sizeof(sizes[0]);
+#define MAX_SIZE sizes[sizes_num - 1]
+    int pipe_parent_to_child[2];
+    char *buffer;
+    int *ticks;
+    struct bench_barrier *barrier;
+    struct bench_stats *stats;
+    pid_t pid;
+    int cpu_parent;
+    int cpu_child;
+    int ret;
+
+    if (!bench_tsc_invariant())
+        fprintf(stderr, "WARNING: TSC is not invariant, one-way latencies are not comparable across cores\n");
+
+    ret = pipe(pipe_parent_to_child);
+    if (-1 == ret)
+        ERROR("pipe parent_to_child", errno);
+
+    barrier = bench_barrier_create(2);
+    if (NULL == barrier)
+        ERROR("bench_barrier_create", errno);
+    stats = bench_stats_create();
+    if (NULL == stats)
+        ERROR("bench_stats_create", errno);
+
+    buffer = malloc(MAX_SIZE);
+    if (NULL == buffer)
+        ERROR("malloc", ENOMEM);
+    memset(buffer, 'a', MAX_SIZE);
+
+    ticks = malloc(MEASUREMENTS * sizeof(int));
+    if (NULL == ticks)
+        ERROR("malloc", ENOMEM);
+    memset(ticks, 0, MEASUREMENTS * sizeof(int));
+
+    pid = getpid();
+    cpu_parent = bench_nth_cpu(0);
+    cpu_child = bench_nth_cpu(1);
+    ret = fork();
+    if (-1 == ret)
+        ERROR("fork", errno);
+
+    if (0 == ret)
+    {
+        /* CHILD Process: receives and timestamps every message */
+        struct bench_oneway_header *header = (struct bench_oneway_header *)buffer;
+        close(pipe_parent_to_child[1]);
+        bench_pin_cpu(cpu_child);
+
+        for (int i = 0; i < sizes_num; i++)
+        {
+            struct timeval tv_start;
+            struct timeval tv_stop;
+
+            bench_barrier_wait(barrier);
+            gettimeofday(&tv_start, NULL);
+            for (int j = 0; j < MEASUREMENTS; j++)
+            {
+                int current_size = sizes[i];
+                char *pos = buffer;
+                do
+                {
+                    int nread = read(pipe_parent_to_child[0], pos, current_size);
+                    if (-1 == nread)
+                        ERROR("read", errno);
+                    pos += nread;
+                    current_size -= nread;
+                } while (current_size > 0);
+                ticks[j] = getrdtsc() - header->tsc;
+                __atomic_store_n(&stats->acked, header->seq, __ATOMIC_RELEASE);
+            }
+            gettimeofday(&tv_stop, NULL);
+
+            bench_stats_compute(stats, ticks, MEASUREMENTS);
+            stats->time_delta_sec = ((tv_stop.tv_sec - tv_start.tv_sec) + ((tv_stop.tv_usec - tv_start.tv_usec) / (1000.0 * 1000.0)));
+            bench_barrier_wait(barrier);
+        }
+
+        close(pipe_parent_to_child[0]);
+        return EXIT_SUCCESS;
+    }
+
+    close(pipe_parent_to_child[0]);
+    bench_pin_cpu(cpu_parent);
+
+    unsigned long long seq = 0;
+    for (int i = 0; i < sizes_num; i++)
+    {
+        struct bench_oneway_header *header = (struct bench_oneway_header *)buffer;
+        int current_size = sizes[i];
+        int nwrite;
+        double mb_per_sec;
+
+        bench_barrier_wait(barrier);
+        for (int j = 0; j < MEASUREMENTS; j++)
+        {
+            int spins = 0;
+            // One message in flight: a message queued behind others in the
+            // pipe would measure the backlog, not the delivery.
+            while (__atomic_load_n(&stats->acked, __ATOMIC_ACQUIRE) != seq)
+                if (spins++ > BARRIER_SPINS)
+                    sched_yield();
+            header->seq = ++seq;
+            header->tsc = getrdtsc();
+            nwrite = write(pipe_parent_to_child[1], buffer, current_size);
+            assert(nwrite == current_size);
+        }
+        // Wait for the child to have read and computed everything.
+        bench_barrier_wait(barrier);
+
+        mb_per_sec = ((double)current_size * MEASUREMENTS) / (1024.0 * 1024.0 * stats->time_delta_sec);
+        printf("PID:%d oneway cpu:%d->%d time: min:%d max:%d Ticks Avg without min/max:%f Ticks (for %d measurements) for %d Bytes (%.2f MB/s)\n",
+               pid, cpu_parent, cpu_child, stats->min_ticks, stats->max_ticks,
+               (double)stats->ticks_all / (MEASUREMENTS - 2.0), MEASUREMENTS, current_size,
+               mb_per_sec);
+    }
+
+    close(pipe_parent_to_child[1]);
+    wait(NULL);
+    bench_stats_destroy(stats);
+    bench_barrier_destroy(barrier);
+    free(ticks);
+    free(buffer);
+
+    return EXIT_SUCCESS;
+#undef MAX_SIZE
+}
+
 int main(int argc, char *argv[])
 {
+    // Usage: bench_pipes [writev|sendmmsg|oneway]
+    // Without argument, one write() per transfer size is measured.
+    if (1 < argc && 0 == strcmp(argv[1], "writev"))
+        return bench_batched(0);
+    if (1 < argc && 0 == strcmp(argv[1], "sendmmsg"))
+        return bench_batched(1);
+    if (1 < argc && 0 == strcmp(argv[1], "oneway"))
+        return bench_oneway();
+
     const int sizes[] = {
         128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768,
         65536, 131072, 262144, 524288, 1048576, 2097152,
@@ -23,6 +368,7 @@ int main(int argc, char *argv[])
 #define MAX_SIZE sizes[sizes_num - 1]
     int pipe_parent_to_child[2];
     char *buffer;
+    struct bench_barrier *barrier;
     pid_t pid;
     pid_t pid_child;
     int ret;
@@ -31,6 +377,10 @@ int main(int argc, char *argv[])
     if (-1 == ret)
         ERROR("pipe parent_to_child", errno);
 
+    barrier = bench_barrier_create(2);
+    if (NULL == barrier)
+        ERROR("bench_barrier_create", errno);
+
     pid = getpid();
     ret = pid_child = fork();
     if (-1 == ret)
@@ -48,6 +398,7 @@ int main(int argc, char *argv[])
 
         for (int i = 0; i < sizes_num; i++)
         {
+            bench_barrier_wait(barrier);
             for (int j = 0; j < MEASUREMENTS; j++)
             {
                 int current_size = sizes[i];
@@ -57,11 +408,9 @@ int main(int argc, char *argv[])
                     current_size -= nread;
                 } while (current_size > 0);
             }
+            bench_barrier_wait(barrier);
         }
 
-        DEBUG(printf("PID:%d (CHILD) waits\n",
-                     (int)pid));
-        pause();
         close(pipe_parent_to_child[0]);
         DEBUG(printf("PID:%d (CHILD) exits\n",
                      (int)pid));
@@ -88,9 +437,13 @@ int main(int argc, char *argv[])
         struct timeval tv_start;
         struct timeval tv_stop;
         double time_delta_sec;
+        double mb_per_sec;
+        double ceiling;
 
         assert(current_size <= MAX_SIZE);
 
+        bench_barrier_wait(barrier);
+
         gettimeofday(&tv_start, NULL);
         for (j = 0; j < MEASUREMENTS; j++)
         {
@@ -104,6 +457,9 @@ int main(int argc, char *argv[])
         }
         gettimeofday(&tv_stop, NULL);
 
+        // Do not start the next size before the child drained this one.
+        bench_barrier_wait(barrier);
+
         min_ticks = INT_MAX;
         max_ticks = INT_MIN;
         ticks_all = 0;
@@ -119,18 +475,18 @@ int main(int argc, char *argv[])
         ticks_all -= max_ticks;
 
         time_delta_sec = ((tv_stop.tv_sec - tv_start.tv_sec) + ((tv_stop.tv_usec - tv_start.tv_usec) / (1000.0 * 1000.0)));
+        mb_per_sec = ((double)current_size * MEASUREMENTS) / (1024.0 * 1024.0 * time_delta_sec);
+        ceiling = bench_memcpy_ceiling(current_size);
 
-        printf("PID:%d time: min:%d max:%d Ticks Avg without min/max:%f Ticks (for %d measurements) for %d Bytes (%.2f MB/s)\n",
+        printf("PID:%d time: min:%d max:%d Ticks Avg without min/max:%f Ticks (for %d measurements) for %d Bytes (%.2f MB/s) %.1f%% of memcpy (%.2f MB/s)\n",
                pid, min_ticks, max_ticks,
                (double)ticks_all / (MEASUREMENTS - 2.0), MEASUREMENTS, nwrite,
-               ((double)current_size * MEASUREMENTS) / (1024.0 * 1024.0 * time_delta_sec));
+               mb_per_sec, 100.0 * mb_per_sec / ceiling, ceiling);
     }
 
-    DEBUG(printf("PID:%d sending shutdown command\n",
-                 (int)pid));
-    kill(pid_child, SIGTERM);
-    wait(NULL);
     close(pipe_parent_to_child[1]);
+    wait(NULL);
+    bench_barrier_destroy(barrier);
 
     return EXIT_SUCCESS;
 }
@@ -23,8 +23,174 @@
 
 #include "bench_utils.h"
 
+/*
+ * One-way mode: the parent writes a message with a bench_oneway_header into
+ * the child's buffer. The header is the last remote iovec, which the kernel
+ * copies after the payload, so once the child sees the new sequence number,
+ * the message is complete. The child computes the delivery latency from the
+ * embedded TSC and acknowledges via shared memory before the next message.
+ * Both sides are pinned to different cores and the child's statistics are
+ * handed back to the parent in shared memory.
+ */
+static int bench_oneway(void)
+{
+    const int sizes[] = {
+        128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768,
+        65536, 131072, 262144, 524288, 1048576};
+    const int sizes_num = sizeof(sizes) / sizeof(sizes[0]);
+#define MAX_SIZE sizes[sizes_num - 1]
+    const int header_size = sizeof(struct bench_oneway_header);
+    int pipe_child_to_parent[2];
+    char *buffer;
+    char *remote_buffer;
+    int *ticks;
+    struct bench_barrier *barrier;
+    struct bench_stats *stats;
+    pid_t pid;
+    pid_t pid_child;
+    int cpu_parent;
+    int cpu_child;
+    int ret;
+
+    if (!bench_tsc_invariant())
+        fprintf(stderr, "WARNING: TSC is not invariant, one-way latencies are not comparable across cores\n");
+
+    ret = pipe(pipe_child_to_parent);
+    if (-1 == ret)
+        ERROR("pipe child_to_parent", errno);
+
+    barrier = bench_barrier_create(2);
+    if (NULL == barrier)
+        ERROR("bench_barrier_create", errno);
+    stats = bench_stats_create();
+    if (NULL == stats)
+        ERROR("bench_stats_create", errno);
+
+    buffer = malloc(MAX_SIZE);
+    if (NULL == buffer)
+        ERROR("malloc", ENOMEM);
+    memset(buffer, 0, MAX_SIZE);
+
+    ticks = malloc(MEASUREMENTS * sizeof(int));
+    if (NULL == ticks)
+        ERROR("malloc", ENOMEM);
+    memset(ticks, 0, MEASUREMENTS * sizeof(int));
+
+    pid = getpid();
+    cpu_parent = bench_nth_cpu(0);
+    cpu_child = bench_nth_cpu(1);
+    ret = pid_child = fork();
+    if (-1 == ret)
+        ERROR("fork", errno);
+
+    if (0 == ret)
+    {
+        /* CHILD Process: polls its own buffer for new messages */
+        volatile struct bench_oneway_header *header = (struct bench_oneway_header *)buffer;
+        unsigned long long seq = 0;
+
+        close(pipe_child_to_parent[0]);
+        bench_pin_cpu(cpu_child);
+
+        remote_buffer = buffer;
+        for (int num_written = 0; num_written < sizeof(char *); num_written += ret)
+            ret = write(pipe_child_to_parent[1], (char *)&remote_buffer + num_written, sizeof(char *) - num_written);
+
+        for (int i = 0; i < sizes_num; i++)
+        {
+            struct timeval tv_start;
+            struct timeval tv_stop;
+
+            bench_barrier_wait(barrier);
+            gettimeofday(&tv_start, NULL);
+            for (int j = 0; j < MEASUREMENTS; j++)
+            {
+                int spins = 0;
+                seq++;
+                while (header->seq != seq)
+                    if (spins++ > BARRIER_SPINS)
+                        sched_yield();
+                ticks[j] = getrdtsc() - header->tsc;
+                __atomic_store_n(&stats->acked, seq, __ATOMIC_RELEASE);
+            }
+            gettimeofday(&tv_stop, NULL);
+
+            bench_stats_compute(stats, ticks, MEASUREMENTS);
+            stats->time_delta_sec = ((tv_stop.tv_sec - tv_start.tv_sec) + ((tv_stop.tv_usec - tv_start.tv_usec) / (1000.0 * 1000.0)));
+            bench_barrier_wait(barrier);
+        }
+
+        exit(EXIT_SUCCESS);
+    }
+
+    struct bench_oneway_header *header = (struct bench_oneway_header *)buffer;
+    struct iovec local[2];
+    struct iovec remote[2];
+    unsigned long long seq = 0;
+
+    close(pipe_child_to_parent[1]);
+    bench_pin_cpu(cpu_parent);
+
+    for (int num_read = 0; num_read < sizeof(char *); num_read += ret)
+        ret = read(pipe_child_to_parent[0], (char *)&remote_buffer + num_read, sizeof(char *) - num_read);
+
+    memset(buffer + header_size, 'a', MAX_SIZE - header_size);
+    local[0].iov_base = buffer + header_size;
+    remote[0].iov_base = remote_buffer + header_size;
+    local[1].iov_base = buffer;
+    local[1].iov_len = header_size;
+    remote[1].iov_base = remote_buffer;
+    remote[1].iov_len = header_size;
+
+    for (int i = 0; i < sizes_num; i++)
+    {
+        int current_size = sizes[i];
+        int nwrite;
+        double mb_per_sec;
+
+        local[0].iov_len = current_size - header_size;
+        remote[0].iov_len = current_size - header_size;
+
+        bench_barrier_wait(barrier);
+        for (int j = 0; j < MEASUREMENTS; j++)
+        {
+            int spins = 0;
+            // Single-slot buffer: do not overwrite a message not yet seen.
+            while (__atomic_load_n(&stats->acked, __ATOMIC_ACQUIRE) != seq)
+                if (spins++ > BARRIER_SPINS)
+                    sched_yield();
+            header->seq = ++seq;
+            header->tsc = getrdtsc();
+            nwrite = process_vm_writev(pid_child, local, 2, remote, 2, 0);
+            assert(nwrite == current_size);
+        }
+        bench_barrier_wait(barrier);
+
+        mb_per_sec = ((double)current_size * MEASUREMENTS) / (1024.0 * 1024.0 * stats->time_delta_sec);
+        printf("PID:%d oneway cpu:%d->%d time: min:%d max:%d Ticks Avg without min/max:%f Ticks (for %d measurements) for %d Bytes (%.2f MB/s)\n",
+               pid, cpu_parent, cpu_child, stats->min_ticks, stats->max_ticks,
+               (double)stats->ticks_all / (MEASUREMENTS - 2.0), MEASUREMENTS, current_size,
+               mb_per_sec);
+    }
+
+    close(pipe_child_to_parent[0]);
+    wait(NULL);
+    bench_stats_destroy(stats);
+    bench_barrier_destroy(barrier);
+    free(ticks);
+    free(buffer);
+
+    return EXIT_SUCCESS;
+#undef MAX_SIZE
+}
+
 int main(int argc, char *argv[])
 {
+    // Usage: bench_process_vm_readv [oneway]
+    // Without argument, only the writing parent is timed.
+    if (1 < argc && 0 == strcmp(argv[1], "oneway"))
+        return bench_oneway();
+
     const int sizes[] = {
         128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768,
         65536, 131072, 262144, 524288, 1048576, 2097152,
@@ -34,6 +200,7 @@ int main(int argc, char *argv[])
     int pipe_child_to_parent[2];
     int pipe_parent_to_child[2];
     char *buffer;
+    struct bench_barrier *barrier;
     pid_t pid;
     pid_t pid_child;
     int ret;
@@ -46,6 +213,10 @@ int main(int argc, char *argv[])
     if (-1 == ret)
         ERROR("pipe parent_to_child", errno);
 
+    barrier = bench_barrier_create(2);
+    if (NULL == barrier)
+        ERROR("bench_barrier_create", errno);
+
     pid = getpid();
     ret = pid_child = fork();
     if (-1 == ret)
@@ -76,6 +247,13 @@ int main(int argc, char *argv[])
         for (num_written = 0, to_write = sizeof(char *); num_written < sizeof(char *); num_written += ret, to_write -= ret)
             ret = write(pipe_child_to_parent[1], ptr + num_written, to_write);
 
+        // Follow the parent through the start and stop of every measured phase.
+        for (int i = 0; i < sizes_num; i++)
+        {
+            bench_barrier_wait(barrier);
+            bench_barrier_wait(barrier);
+        }
+
         DEBUG(printf("PID:%d (CHILD) waits\n",
                      (int)pid));
         ret = read(pipe_parent_to_child[0], &num_written, 1);
@@ -132,12 +310,16 @@ int main(int argc, char *argv[])
         struct timeval tv_start;
         struct timeval tv_stop;
         double time_delta_sec;
+        double mb_per_sec;
+        double ceiling;
 
         assert(current_size <= MAX_SIZE);
 
         local[0].iov_len = current_size;
         remote[0].iov_len = current_size;
 
+        bench_barrier_wait(barrier);
+
         gettimeofday(&tv_start, NULL);
         for (j = 0; j < MEASUREMENTS; j++)
         {
@@ -151,6 +333,8 @@ int main(int argc, char *argv[])
         }
         gettimeofday(&tv_stop, NULL);
 
+        bench_barrier_wait(barrier);
+
         min_ticks = INT_MAX;
         max_ticks = INT_MIN;
         ticks_all = 0;
@@ -166,11 +350,13 @@ int main(int argc, char *argv[])
         ticks_all -= max_ticks;
 
         time_delta_sec = ((tv_stop.tv_sec - tv_start.tv_sec) + ((tv_stop.tv_usec - tv_start.tv_usec) / (1000.0 * 1000.0)));
+        mb_per_sec = ((double)current_size * MEASUREMENTS) / (1024.0 * 1024.0 * time_delta_sec);
+        ceiling = bench_memcpy_ceiling(current_size);
 
-        printf("PID:%d time: min:%d max:%d Ticks Avg without min/max:%f Ticks (for %d measurements) for %d Bytes (%.2f MB/s)\n",
+        printf("PID:%d time: min:%d max:%d Ticks Avg without min/max:%f Ticks (for %d measurements) for %d Bytes (%.2f MB/s) %.1f%% of memcpy (%.2f MB/s)\n",
                pid, min_ticks, max_ticks,
                (double)ticks_all / (MEASUREMENTS - 2.0), MEASUREMENTS, nwrite,
-               ((double)current_size * MEASUREMENTS) / (1024.0 * 1024.0 * time_delta_sec));
+               mb_per_sec, 100.0 * mb_per_sec / ceiling, ceiling);
     }
 
     // Tell Child to exit, too:
@@ -178,6 +364,7 @@ int main(int argc, char *argv[])
 
     close(pipe_parent_to_child[1]);
     wait(NULL);
+    bench_barrier_destroy(barrier);
 
     return EXIT_SUCCESS;
 }
@@ -14,11 +14,10 @@
 #include <string.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include "bench_utils.h"
 
-#define SLEEP_TIME 10
-
 void signal_handler(int signum)
 {
     DEBUG(printf("Caught signal %d\n", signum));
@@ -30,11 +29,20 @@ int main(int argc, char *argv[])
 {
     pid_t pid;
     pid_t pid_child;
+    struct bench_barrier *barrier;
     int ret;
     const double current_size = 1. / 8.; // Assume a signal is 1 Bit worth of data...
 
     pid = getpid();
 
+    barrier = bench_barrier_create(2);
+    if (NULL == barrier)
+        ERROR("bench_barrier_create", errno);
+
+    // Install the handler before forking, so no signal may hit the default action.
+    if (SIG_ERR == signal(SIGUSR1, &signal_handler))
+        ERROR("signal", errno);
+
     ret = pid_child = fork();
     if (ret == -1)
         ERROR("fork", errno);
@@ -56,6 +64,8 @@ int main(int argc, char *argv[])
             ERROR("malloc", ENOMEM);
         memset(ticks, 0, MEASUREMENTS * sizeof(int));
 
+        bench_barrier_wait(barrier);
+
         gettimeofday(&tv_start, NULL);
         for (i = 0; i < MEASUREMENTS; i++)
         {
@@ -67,6 +77,8 @@ int main(int argc, char *argv[])
         }
         gettimeofday(&tv_stop, NULL);
 
+        bench_barrier_wait(barrier);
+
         min_ticks = INT_MAX;
         max_ticks = INT_MIN;
         ticks_all = 0;
@@ -95,11 +107,12 @@ int main(int argc, char *argv[])
         DEBUG(printf("PID:%d (PARENT) Waiting for signals from Child pid:%d\n",
                      (int)pid, (int)pid_child));
 
-        if (SIG_ERR == signal(SIGUSR1, &signal_handler))
-            ERROR("signal", errno);
+        // Receive signals until the child finished its measured phase.
+        bench_barrier_wait(barrier);
+        bench_barrier_wait(barrier);
+        wait(NULL);
+        bench_barrier_destroy(barrier);
     }
 
-    // Both Child and Parent sleep shortly to allow signals to be received.
-    sleep(SLEEP_TIME);
     return 0;
 }
@@ -0,0 +1,211 @@
+/*
+ * STREAM-style memory bandwidth baseline (copy, scale, add and triad),
+ * measured with one thread and with one thread per online core.
+ * It gives the machine's limit that the MB/s of the IPC benchmarks can be
+ * compared against, see also bench_memcpy_ceiling() in bench_utils.h.
+ */
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "bench_utils.h"
+
+// Each of the three arrays has to be well beyond the last level cache.
+#ifndef STREAM_ARRAY_SIZE
+#define STREAM_ARRAY_SIZE (8 * 1024 * 1024)
+#endif
+
+#ifndef NTIMES
+#define NTIMES (10)
+#endif
+
+enum kernel
+{
+    KERNEL_COPY,
+    KERNEL_SCALE,
+    KERNEL_ADD,
+    KERNEL_TRIAD,
+    KERNEL_NUM,
+};
+
+static const char *kernel_names[KERNEL_NUM] = {"copy", "scale", "add", "triad"};
+// Number of arrays touched per element, i.e. bytes moved = arrays * sizeof(double).
+static const int kernel_arrays[KERNEL_NUM] = {2, 2, 3, 3};
+
+static double *a;
+static double *b;
+static double *c;
+
+struct worker
+{
+    pthread_t thread;
+    long begin;
+    long end;
+    struct bench_barrier *barrier;
+};
+
+static void run_kernel(enum kernel k, long begin, long end)
+{
+    const double scalar = 3.0;
+    long i;
+
+    switch (k)
+    {
+    case KERNEL_COPY:
+        for (i = begin; i < end; i++)
+            c[i] = a[i];
+        break;
+    case KERNEL_SCALE:
+        for (i = begin; i < end; i++)
+            b[i] = scalar * c[i];
+        break;
+    case KERNEL_ADD:
+        for (i = begin; i < end; i++)
+            c[i] = a[i] + b[i];
+        break;
+    case KERNEL_TRIAD:
+        for (i = begin; i < end; i++)
+            a[i] = b[i] + scalar * c[i];
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Every worker first-touches its own chunk, and then runs each kernel between
+ * two barriers, so the main thread (worker 0) may time exactly one pass.
+ */
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    long i;
+
+    for (i = w->begin; i < w->end; i++)
+    {
+        a[i] = 1.0;
+        b[i] = 2.0;
+        c[i] = 0.0;
+    }
+    bench_barrier_wait(w->barrier);
+
+    for (int n = 0; n < NTIMES; n++)
+        for (int k = 0; k < KERNEL_NUM; k++)
+        {
+            bench_barrier_wait(w->barrier);
+            run_kernel(k, w->begin, w->end);
+            bench_barrier_wait(w->barrier);
+        }
+    return NULL;
+}
+
+static void bench_stream(int threads)
+{
+    pid_t pid = getpid();
+    struct worker *workers;
+    struct bench_barrier *barrier;
+    double min_sec[KERNEL_NUM];
+    double sum_sec[KERNEL_NUM];
+    long chunk = (STREAM_ARRAY_SIZE + threads - 1) / threads;
+    int t;
+
+    workers = malloc(threads * sizeof(struct worker));
+    if (NULL == workers)
+        ERROR("malloc", ENOMEM);
+    barrier = bench_barrier_create(threads);
+    if (NULL == barrier)
+        ERROR("bench_barrier_create", errno);
+
+    for (t = 0; t < threads; t++)
+    {
+        workers[t].begin = t * chunk < STREAM_ARRAY_SIZE ? t * chunk : STREAM_ARRAY_SIZE;
+        workers[t].end = (t + 1) * chunk < STREAM_ARRAY_SIZE ? (t + 1) * chunk : STREAM_ARRAY_SIZE;
+        workers[t].barrier = barrier;
+        if (t > 0)
+        {
+            int ret = pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+            if (0 != ret)
+                ERROR("pthread_create", ret);
+        }
+    }
+
+    /* Worker 0 is the main thread, which also does the timing. */
+    for (long i = workers[0].begin; i < workers[0].end; i++)
+    {
+        a[i] = 1.0;
+        b[i] = 2.0;
+        c[i] = 0.0;
+    }
+    bench_barrier_wait(barrier);
+
+    for (int k = 0; k < KERNEL_NUM; k++)
+    {
+        min_sec[k] = DBL_MAX;
+        sum_sec[k] = 0.0;
+    }
+    for (int n = 0; n < NTIMES; n++)
+        for (int k = 0; k < KERNEL_NUM; k++)
+        {
+            struct timeval tv_start;
+            struct timeval tv_stop;
+            double time_delta_sec;
+
+            // Start the clock before releasing the workers, so none may run ahead.
+            gettimeofday(&tv_start, NULL);
+            bench_barrier_wait(barrier);
+            run_kernel(k, workers[0].begin, workers[0].end);
+            bench_barrier_wait(barrier);
+            gettimeofday(&tv_stop, NULL);
+
+            time_delta_sec = ((tv_stop.tv_sec - tv_start.tv_sec) + ((tv_stop.tv_usec - tv_start.tv_usec) / (1000.0 * 1000.0)));
+            // The first pass warms up caches and TLBs, like in the original STREAM.
+            if (n == 0)
+                continue;
+            if (min_sec[k] > time_delta_sec)
+                min_sec[k] = time_delta_sec;
+            sum_sec[k] += time_delta_sec;
+        }
+
+    for (t = 1; t < threads; t++)
+        pthread_join(workers[t].thread, NULL);
+
+    for (int k = 0; k < KERNEL_NUM; k++)
+    {
+        double bytes = (double)kernel_arrays[k] * sizeof(double) * STREAM_ARRAY_SIZE;
+        printf("PID:%d threads:%d %-5s time: min:%f avg:%f sec (for %d measurements) for %.0f Bytes (%.2f MB/s best, %.2f MB/s avg)\n",
+               pid, threads, kernel_names[k], min_sec[k], sum_sec[k] / (NTIMES - 1), NTIMES - 1, bytes,
+               bytes / (1024.0 * 1024.0 * min_sec[k]),
+               bytes / (1024.0 * 1024.0 * (sum_sec[k] / (NTIMES - 1))));
+    }
+
+    bench_barrier_destroy(barrier);
+    free(workers);
+}
+
+int main(int argc, char *argv[])
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    a = malloc(STREAM_ARRAY_SIZE * sizeof(double));
+    b = malloc(STREAM_ARRAY_SIZE * sizeof(double));
+    c = malloc(STREAM_ARRAY_SIZE * sizeof(double));
+    if (NULL == a || NULL == b || NULL == c)
+        ERROR("malloc", ENOMEM);
+
+    bench_stream(1);
+    if (cores > 1)
+        bench_stream(cores);
+
+    free(a);
+    free(b);
+    free(c);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,336 @@
+/*
+ * Benchmark of the same transports between two processes and between two
+ * threads of one process, to separate the cost of process isolation
+ * (separate address spaces, TLB flushes on switch) from the transport itself.
+ *
+ * Each transport is measured as a ping-pong: the producer hands a message of
+ * the given size to the consumer and waits for a short acknowledgement.
+ * The forked and the threaded variant run the very same producer/consumer
+ * functions and are printed next to each other. The consumer receives into a
+ * buffer of its own and both sides are pinned to different cores, so threads
+ * do not share cache lines the forked variant has private copies of.
+ */
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "bench_utils.h"
+
+#define MAX_SIZE (65536)
+
+enum transport
+{
+    TRANSPORT_PIPE,
+    TRANSPORT_SHM,
+    TRANSPORT_EVENTFD,
+};
+
+static const char *transport_names[] = {"pipe", "shm", "eventfd"};
+
+/* Single-slot buffer handed back and forth via two sequence counters. */
+struct shm_slot
+{
+    unsigned int sent;
+    unsigned int acked;
+    char data[MAX_SIZE];
+};
+
+struct channel
+{
+    enum transport transport;
+    const char *variant;
+    int size;
+    int to_consumer[2];
+    int to_producer[2];
+    struct shm_slot *slot;
+    struct bench_barrier *barrier;
+    char *buffer;
+    char *received;
+    int cpu_producer;
+    int cpu_consumer;
+};
+
+static void shm_wait_for(unsigned int *counter, unsigned int value)
+{
+    int spins = 0;
+    while (__atomic_load_n(counter, __ATOMIC_ACQUIRE) != value)
+    {
+        if (spins++ < BARRIER_SPINS)
+            continue;
+        sched_yield();
+    }
+}
+
+static void transfer(int fd, char *buffer, int size, int writing)
+{
+    while (size > 0)
+    {
+        int n = writing ? write(fd, buffer, size) : read(fd, buffer, size);
+        if (-1 == n)
+            ERROR(writing ? "write" : "read", errno);
+        buffer += n;
+        size -= n;
+    }
+}
+
+static void *consumer(void *arg)
+{
+    struct channel *ch = arg;
+    uint64_t value = 1;
+    char ack = 0;
+    int j;
+
+    bench_pin_cpu(ch->cpu_consumer);
+    bench_barrier_wait(ch->barrier);
+    for (j = 0; j < MEASUREMENTS; j++)
+    {
+        switch (ch->transport)
+        {
+        case TRANSPORT_PIPE:
+            transfer(ch->to_consumer[0], ch->received, ch->size, 0);
+            transfer(ch->to_producer[1], &ack, 1, 1);
+            break;
+        case TRANSPORT_SHM:
+            shm_wait_for(&ch->slot->sent, j + 1);
+            memcpy(ch->received, ch->slot->data, ch->size);
+            __atomic_store_n(&ch->slot->acked, j + 1, __ATOMIC_RELEASE);
+            break;
+        case TRANSPORT_EVENTFD:
+            transfer(ch->to_consumer[0], (char *)&value, sizeof(value), 0);
+            transfer(ch->to_producer[1], (char *)&value, sizeof(value), 1);
+            break;
+        }
+    }
+    bench_barrier_wait(ch->barrier);
+    return NULL;
+}
+
+static double producer(struct channel *ch, int *ticks)
+{
+    pid_t pid = getpid();
+    uint64_t value = 1;
+    char ack = 0;
+    int j;
+    int min_ticks;
+    int max_ticks;
+    long long ticks_all;
+    struct timeval tv_start;
+    struct timeval tv_stop;
+    double time_delta_sec;
+
+    bench_barrier_wait(ch->barrier);
+    gettimeofday(&tv_start, NULL);
+    for (j = 0; j < MEASUREMENTS; j++)
+    {
+        unsigned long long start;
+        unsigned long long stop;
+        start = getrdtsc();
+        switch (ch->transport)
+        {
+        case TRANSPORT_PIPE:
+            transfer(ch->to_consumer[1], ch->buffer, ch->size, 1);
+            transfer(ch->to_producer[0], &ack, 1, 0);
+            break;
+        case TRANSPORT_SHM:
+            memcpy(ch->slot->data, ch->buffer, ch->size);
+            __atomic_store_n(&ch->slot->sent, j + 1, __ATOMIC_RELEASE);
+            shm_wait_for(&ch->slot->acked, j + 1);
+            break;
+        case TRANSPORT_EVENTFD:
+            transfer(ch->to_consumer[1], (char *)&value, sizeof(value), 1);
+            transfer(ch->to_producer[0], (char *)&value, sizeof(value), 0);
+            break;
+        }
+        stop = getrdtsc();
+        ticks[j] = stop - start;
+    }
+    gettimeofday(&tv_stop, NULL);
+    bench_barrier_wait(ch->barrier);
+
+    min_ticks = INT_MAX;
+    max_ticks = INT_MIN;
+    ticks_all = 0;
+    for (j = 0; j < MEASUREMENTS; j++)
+    {
+        if (min_ticks > ticks[j])
+            min_ticks = ticks[j];
+        if (max_ticks < ticks[j])
+            max_ticks = ticks[j];
+        ticks_all += ticks[j];
+    }
+    ticks_all -= min_ticks;
+    ticks_all -= max_ticks;
+
+    time_delta_sec = ((tv_stop.tv_sec - tv_start.tv_sec) + ((tv_stop.tv_usec - tv_start.tv_usec) / (1000.0 * 1000.0)));
+
+    printf("PID:%d %s %s time: min:%d max:%d Ticks Avg without min/max:%f Ticks (for %d measurements) for %d Bytes (%.2f MB/s)\n",
+           pid, transport_names[ch->transport], ch->variant, min_ticks, max_ticks,
+           (double)ticks_all / (MEASUREMENTS - 2.0), MEASUREMENTS, ch->size,
+           ((double)ch->size * MEASUREMENTS) / (1024.0 * 1024.0 * time_delta_sec));
+    return (double)ticks_all / (MEASUREMENTS - 2.0);
+}
+
+static void channel_open(struct channel *ch)
+{
+    int ret = 0;
+
+    switch (ch->transport)
+    {
+    case TRANSPORT_PIPE:
+        if (-1 == pipe(ch->to_consumer) || -1 == pipe(ch->to_producer))
+            ret = -1;
+        break;
+    case TRANSPORT_SHM:
+        ch->slot->sent = 0;
+        ch->slot->acked = 0;
+        break;
+    case TRANSPORT_EVENTFD:
+#if defined(__linux__)
+        ch->to_consumer[0] = ch->to_consumer[1] = eventfd(0, 0);
+        ch->to_producer[0] = ch->to_producer[1] = eventfd(0, 0);
+        if (-1 == ch->to_consumer[0] || -1 == ch->to_producer[0])
+            ret = -1;
+#endif
+        break;
+    }
+    if (-1 == ret)
+        ERROR(transport_names[ch->transport], errno);
+}
+
+static void channel_close(struct channel *ch)
+{
+    switch (ch->transport)
+    {
+    case TRANSPORT_PIPE:
+        close(ch->to_consumer[0]);
+        close(ch->to_consumer[1]);
+        close(ch->to_producer[0]);
+        close(ch->to_producer[1]);
+        break;
+    case TRANSPORT_SHM:
+        break;
+    case TRANSPORT_EVENTFD:
+        close(ch->to_consumer[0]);
+        close(ch->to_producer[0]);
+        break;
+    }
+}
+
+static double run_forked(struct channel *ch, int *ticks)
+{
+    double avg;
+    pid_t pid_child;
+
+    ch->variant = "fork";
+    channel_open(ch);
+    // Do not let the child inherit (and print again) pending output.
+    fflush(stdout);
+    pid_child = fork();
+    if (-1 == pid_child)
+        ERROR("fork", errno);
+    if (0 == pid_child)
+    {
+        /* CHILD */
+        consumer(ch);
+        exit(EXIT_SUCCESS);
+    }
+    avg = producer(ch, ticks);
+    waitpid(pid_child, NULL, 0);
+    channel_close(ch);
+    return avg;
+}
+
+static double run_threaded(struct channel *ch, int *ticks)
+{
+    double avg;
+    pthread_t thread;
+    int ret;
+
+    ch->variant = "thread";
+    channel_open(ch);
+    ret = pthread_create(&thread, NULL, consumer, ch);
+    if (0 != ret)
+        ERROR("pthread_create", ret);
+    avg = producer(ch, ticks);
+    pthread_join(thread, NULL);
+    channel_close(ch);
+    return avg;
+}
+
+int main(int argc, char *argv[])
+{
+    const int sizes[] = {128, 1024, 4096, 16384, 65536};
+    const int sizes_num = sizeof(sizes) / sizeof(sizes[0]);
+    struct channel ch;
+    int *ticks;
+
+    ticks = malloc(MEASUREMENTS * sizeof(int));
+    if (NULL == ticks)
+        ERROR("malloc", ENOMEM);
+    memset(ticks, 0, MEASUREMENTS * sizeof(int));
+
+    memset(&ch, 0, sizeof(ch));
+    ch.barrier = bench_barrier_create(2);
+    if (NULL == ch.barrier)
+        ERROR("bench_barrier_create", errno);
+    ch.slot = mmap(NULL, sizeof(struct shm_slot), PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, -1, 0);
+    if (ch.slot == MAP_FAILED)
+        ERROR("mmap anon", errno);
+    ch.buffer = malloc(MAX_SIZE);
+    ch.received = malloc(MAX_SIZE);
+    if (NULL == ch.buffer || NULL == ch.received)
+        ERROR("malloc", ENOMEM);
+    memset(ch.buffer, 'a', MAX_SIZE);
+    memset(ch.received, 0, MAX_SIZE);
+
+    // Determine both CPUs before pinning, as pinning shrinks the mask. The
+    // producer always runs in the main thread, the consumer pins itself.
+    ch.cpu_producer = bench_nth_cpu(0);
+    ch.cpu_consumer = bench_nth_cpu(1);
+    bench_pin_cpu(ch.cpu_producer);
+
+    for (ch.transport = TRANSPORT_PIPE; ch.transport <= TRANSPORT_EVENTFD; ch.transport++)
+    {
+#if !defined(__linux__)
+        if (ch.transport == TRANSPORT_EVENTFD)
+            break;
+#endif
+        for (int i = 0; i < sizes_num; i++)
+        {
+            double fork_avg;
+            double thread_avg;
+
+            // An eventfd only ever carries its 8 byte counter.
+            ch.size = ch.transport == TRANSPORT_EVENTFD ? (int)sizeof(uint64_t) : sizes[i];
+
+            fork_avg = run_forked(&ch, ticks);
+            thread_avg = run_threaded(&ch, ticks);
+            printf("%s %d Bytes: fork/thread round trip ratio %.2f\n",
+                   transport_names[ch.transport], ch.size, fork_avg / thread_avg);
+
+            if (ch.transport == TRANSPORT_EVENTFD)
+                break;
+        }
+    }
+
+    free(ch.buffer);
+    free(ch.received);
+    munmap(ch.slot, sizeof(struct shm_slot));
+    bench_barrier_destroy(ch.barrier);
+    free(ticks);
+
+    return EXIT_SUCCESS;
+}
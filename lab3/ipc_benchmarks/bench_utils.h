@@ -7,6 +7,21 @@
 #ifndef __BENCH_UTILS_H__
 #define __BENCH_UTILS_H__
 
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 /**************************************************************
  * Macro definitions
  **************************************************************/
@@ -25,6 +40,29 @@
         exit(e);                                           \
     } while (0)
 
+// Number of busy-wait iterations in bench_barrier_wait before going to sleep.
+// Keeps the handshake fast on multi-core machines without burning a core
+// while the other process is busy in a long measured phase.
+#ifndef BARRIER_SPINS
+#define BARRIER_SPINS (1000)
+#endif
+
+// Amount of data copied by bench_memcpy_ceiling to get a stable reference rate.
+#ifndef CEILING_BYTES
+#define CEILING_BYTES (256 * 1024 * 1024)
+#endif
+
+// Upper bound of memcpy calls per size, small sizes would otherwise measure
+// the call overhead hundreds of millions of times.
+#ifndef CEILING_MAX_COPIES
+#define CEILING_MAX_COPIES (1000 * 1000)
+#endif
+
+// Number of sizes bench_memcpy_ceiling remembers the rate of.
+#ifndef CEILING_CACHE_SIZE
+#define CEILING_CACHE_SIZE (64)
+#endif
+
 /* Comment out the following line to get DEBUG-output */
 // #define DEBUG(x) x;
 #define DEBUG(x)
@@ -53,6 +91,251 @@ extern "C"
         return x;
     }
 
+    /*
+     * Measure the single-threaded memcpy rate in MB/s for buffers of the given
+     * size. Used as the reference ceiling the transports are reported against,
+     * see bench_stream.c for the full memory-bandwidth baseline. Each size is
+     * only measured once, later calls return the remembered rate.
+     */
+    inline static double bench_memcpy_ceiling(int size)
+    {
+        static int cached_sizes[CEILING_CACHE_SIZE];
+        static double cached_rates[CEILING_CACHE_SIZE];
+        static int cached_num = 0;
+        struct timeval tv_start;
+        struct timeval tv_stop;
+        double time_delta_sec;
+        double rate;
+        long long copies = CEILING_BYTES / size;
+        char *src;
+        char *dst;
+
+        for (int i = 0; i < cached_num; i++)
+            if (cached_sizes[i] == size)
+                return cached_rates[i];
+
+        if (copies > CEILING_MAX_COPIES)
+            copies = CEILING_MAX_COPIES;
+        if (copies < 2)
+            copies = 2;
+        src = malloc(size);
+        dst = malloc(size);
+        if (NULL == src || NULL == dst)
+            ERROR("malloc", ENOMEM);
+        // Touch both buffers once, so page faults are not measured.
+        memset(src, 'a', size);
+        memcpy(dst, src, size);
+
+        gettimeofday(&tv_start, NULL);
+        for (long long i = 0; i < copies; i++)
+        {
+            memcpy(dst, src, size);
+            __asm__ volatile(""
+                             :
+                             : "r"(dst)
+                             : "memory");
+        }
+        gettimeofday(&tv_stop, NULL);
+
+        free(src);
+        free(dst);
+
+        time_delta_sec = ((tv_stop.tv_sec - tv_start.tv_sec) + ((tv_stop.tv_usec - tv_start.tv_usec) / (1000.0 * 1000.0)));
+        rate = ((double)size * copies) / (1024.0 * 1024.0 * time_delta_sec);
+        if (cached_num < CEILING_CACHE_SIZE)
+        {
+            cached_sizes[cached_num] = size;
+            cached_rates[cached_num] = rate;
+            cached_num++;
+        }
+        return rate;
+    }
+
+    /*
+     * Header carried at the start of every message in the one-way modes: the
+     * sender's TSC right before handing the message to the transport, and a
+     * sequence number the receiver may poll on.
+     */
+    struct bench_oneway_header
+    {
+        unsigned long long tsc;
+        unsigned long long seq;
+    };
+
+    /*
+     * Receiver-side results, kept in an anonymous shared mapping so that the
+     * child may hand them back to the parent for printing.
+     */
+    struct bench_stats
+    {
+        int min_ticks;
+        int max_ticks;
+        long long ticks_all;
+        double time_delta_sec;
+        unsigned long long acked;
+    };
+
+    inline static struct bench_stats *bench_stats_create(void)
+    {
+        struct bench_stats *stats;
+        stats = mmap(NULL, sizeof(struct bench_stats), PROT_READ | PROT_WRITE,
+                     MAP_ANON | MAP_SHARED, -1, 0);
+        if (stats == MAP_FAILED)
+            return NULL;
+        memset(stats, 0, sizeof(struct bench_stats));
+        return stats;
+    }
+
+    /* Compute min, max and the sum without min/max, as printed by all benchmarks. */
+    inline static void bench_stats_compute(struct bench_stats *stats, const int *ticks, int num)
+    {
+        stats->min_ticks = INT_MAX;
+        stats->max_ticks = INT_MIN;
+        stats->ticks_all = 0;
+        for (int j = 0; j < num; j++)
+        {
+            if (stats->min_ticks > ticks[j])
+                stats->min_ticks = ticks[j];
+            if (stats->max_ticks < ticks[j])
+                stats->max_ticks = ticks[j];
+            stats->ticks_all += ticks[j];
+        }
+        stats->ticks_all -= stats->min_ticks;
+        stats->ticks_all -= stats->max_ticks;
+    }
+
+    inline static void bench_stats_destroy(struct bench_stats *stats)
+    {
+        munmap(stats, sizeof(struct bench_stats));
+    }
+
+    /*
+     * Return the n-th CPU of the calling process' affinity mask, wrapping
+     * around if there are fewer CPUs, or -1 if affinity is not supported.
+     * Determine all CPUs before pinning, as pinning shrinks the mask.
+     * Requires _GNU_SOURCE to be defined by the benchmark.
+     */
+    inline static int bench_nth_cpu(int nth)
+    {
+#if defined(__linux__) && defined(CPU_SET)
+        cpu_set_t allowed;
+        int count;
+
+        if (-1 == sched_getaffinity(0, sizeof(allowed), &allowed))
+            return -1;
+        count = CPU_COUNT(&allowed);
+        if (count == 0)
+            return -1;
+        nth %= count;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &allowed) && nth-- == 0)
+                return cpu;
+#endif
+        return -1;
+    }
+
+    /* Pin the calling process (or thread) to the given CPU. */
+    inline static int bench_pin_cpu(int cpu)
+    {
+#if defined(__linux__) && defined(CPU_SET)
+        cpu_set_t pinned;
+
+        if (cpu < 0)
+            return -1;
+        CPU_ZERO(&pinned);
+        CPU_SET(cpu, &pinned);
+        return sched_setaffinity(0, sizeof(pinned), &pinned);
+#else
+        return -1;
+#endif
+    }
+
+    /*
+     * Returns non-zero if the TSC is invariant, i.e. runs at a constant rate in
+     * all P-/C-states and is therefore comparable across cores.
+     */
+    inline static int bench_tsc_invariant(void)
+    {
+#if defined(__i386__) || defined(__x86_64__)
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+            return 0;
+        return (edx >> 8) & 1;
+#else
+        return 0;
+#endif
+    }
+
+    /*
+     * Sense-reversing barrier living in an anonymous shared mapping, so that it
+     * survives fork() and may be used between parent and child processes.
+     * Every party calls bench_barrier_wait(); the last one to arrive releases
+     * all others by bumping the generation counter. Waiters spin shortly and
+     * then sleep on the generation counter (futex on Linux).
+     */
+    struct bench_barrier
+    {
+        int parties;
+        int count;
+        int sleepers;
+        unsigned int generation;
+    };
+
+    inline static struct bench_barrier *bench_barrier_create(int parties)
+    {
+        struct bench_barrier *barrier;
+        barrier = mmap(NULL, sizeof(struct bench_barrier), PROT_READ | PROT_WRITE,
+                       MAP_ANON | MAP_SHARED, -1, 0);
+        if (barrier == MAP_FAILED)
+            return NULL;
+        barrier->parties = parties;
+        barrier->count = 0;
+        barrier->sleepers = 0;
+        barrier->generation = 0;
+        return barrier;
+    }
+
+    inline static void bench_barrier_wait(struct bench_barrier *barrier)
+    {
+        unsigned int generation = __atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE);
+        int spins = 0;
+
+        if (__atomic_add_fetch(&barrier->count, 1, __ATOMIC_ACQ_REL) == barrier->parties)
+        {
+            __atomic_store_n(&barrier->count, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&barrier->generation, generation + 1, __ATOMIC_SEQ_CST);
+#if defined(__linux__)
+            if (__atomic_load_n(&barrier->sleepers, __ATOMIC_SEQ_CST) > 0)
+                syscall(SYS_futex, &barrier->generation, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+            return;
+        }
+
+        while (__atomic_load_n(&barrier->generation, __ATOMIC_ACQUIRE) == generation)
+        {
+            if (spins < BARRIER_SPINS)
+            {
+                spins++;
+#if defined(__i386__) || defined(__x86_64__)
+                __asm__ volatile("pause\n");
+#endif
+                continue;
+            }
+#if defined(__linux__)
+            __atomic_add_fetch(&barrier->sleepers, 1, __ATOMIC_SEQ_CST);
+            syscall(SYS_futex, &barrier->generation, FUTEX_WAIT, generation, NULL, NULL, 0);
+            __atomic_sub_fetch(&barrier->sleepers, 1, __ATOMIC_SEQ_CST);
+#else
+            sched_yield();
+#endif
+        }
+    }
+
+    inline static void bench_barrier_destroy(struct bench_barrier *barrier)
+    {
+        munmap(barrier, sizeof(struct bench_barrier));
+    }
+
 #if defined(__cplusplus)
 }
  /* extern "C" */